@@ -0,0 +1,147 @@
+/*
+ *  © 2026 agent
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "BinaryProtocol.h"
+#include "DCC.h"
+#include "Turnouts.h"
+#include "DIAG.h"
+
+unsigned int BinaryProtocol::truncatedFrames=0;
+
+void BinaryProtocol::parse(Print * stream, const byte * buffer, int length) {
+  int pos=0;
+  while (pos < length) {
+    if (buffer[pos]!=FRAME_START) {
+      pos++;  // resync on next START
+      continue;
+    }
+    if (pos+1 < length && buffer[pos+1]==0) {
+      pos++;  // no opcode, not a frame
+      continue;
+    }
+    if (pos+1 >= length || pos+3+buffer[pos+1] > length) {
+      // The rest is in a later read, and frames are not put back together
+      // across reads, so tell the client rather than lose it silently.
+      truncatedFrames++;
+      if (Diag::CMD) DIAG(F("Binary frame truncated"));
+      reject(stream, pos+2 < length ? buffer[pos+2] : 0);
+      break;
+    }
+    byte frameLength=buffer[pos+1];
+    const byte * data=buffer+pos+2;
+    if (crc8(buffer+pos+1, frameLength+1)!=data[frameLength]) {
+      if (Diag::CMD) DIAG(F("Binary frame CRC error"));
+      pos++;
+      continue;
+    }
+    pos+=3+frameLength;
+
+    // decode params
+    byte opcode=data[0];
+    int32_t p[MAX_PARAMS];
+    byte count=0;
+    bool ok=true;
+    for (byte i=1; i<frameLength && ok;) {
+      if (count==MAX_PARAMS) {
+        ok=false;
+        break;
+      }
+      uint32_t value=0;
+      byte shift=0;
+      byte b;
+      do {
+        if (i==frameLength || shift>28) {
+          ok=false;
+          break;
+        }
+        b=data[i++];
+        value |= (uint32_t)(b & 0x7F) << shift;
+        shift+=7;
+      } while (b & 0x80);
+      p[count++]=(int32_t)(value>>1) ^ -(int32_t)(value & 1);  // unzigzag
+    }
+
+    if (!ok || !execute(opcode, count, p)) reject(stream, opcode);
+  }
+}
+
+void BinaryProtocol::reject(Print * stream, byte opcode) {
+  int32_t reply[1]={opcode};
+  byte frame[MAX_FRAME];
+  stream->write(frame, encode(frame, OP_ERROR, 1, reply));
+}
+
+// Params are int32, so ids are checked against what the text commands can 
+// give before they are narrowed: cab 65539 must not drive loco 3.
+bool BinaryProtocol::execute(byte opcode, byte count, const int32_t p[]) {
+  switch (opcode) {
+    case OP_THROTTLE: {  // cab speed direction, converted as for <t>
+      if (count!=3) return false;
+      if (p[0] < 0 || p[0] > 10239) return false;
+      int32_t tspeed=p[1];
+      if (tspeed > 126 || tspeed < -1) return false;
+      if (tspeed < 0) tspeed = 1;  // emergency stop DCC speed
+      else if (tspeed > 0) tspeed++;  // map 1-126 -> 2-127
+      if (p[0] == 0 && tspeed > 1) return false;  // ignore broadcasts of speed>1
+      if (p[2] < 0 || p[2] > 1) return false;
+      DCC::setThrottle(p[0], tspeed, p[2]);
+      return true;
+    }
+    case OP_FUNCTION:  // cab function on
+      if (count!=3) return false;
+      if (p[0] < 1 || p[0] > 10239 || p[1] < 0 || p[1] > 32767) return false;
+      DCC::setFn(p[0], p[1], p[2]==1);
+      return true;
+
+    case OP_TURNOUT:  // id closed
+      if (count!=2) return false;
+      if (p[0] < 0 || p[0] > 32767) return false;
+      return Turnout::setClosed(p[0], p[1]!=0);
+
+    default:
+      return false;
+  }
+}
+
+byte BinaryProtocol::encode(byte * buffer, byte opcode, byte count, const int32_t params[]) {
+  byte pos=2;
+  buffer[0]=FRAME_START;
+  buffer[pos++]=opcode;
+  for (byte i=0; i<count && i<MAX_PARAMS; i++) {
+    uint32_t value=((uint32_t)params[i] << 1) ^ (uint32_t)(params[i] >> 31);  // zigzag
+    while (value >= 0x80) {
+      buffer[pos++]=(value & 0x7F) | 0x80;
+      value >>= 7;
+    }
+    buffer[pos++]=value;
+  }
+  buffer[1]=pos-2;
+  buffer[pos]=crc8(buffer+1, pos-1);
+  return pos+1;
+}
+
+byte BinaryProtocol::crc8(const byte * data, byte length) {
+  byte crc=0;
+  while (length--) {
+    crc ^= *data++;
+    for (byte bit=0; bit<8; bit++)
+      crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+  }
+  return crc;
+}
@@ -0,0 +1,84 @@
+/*
+ *  © 2026 agent
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef BinaryProtocol_h
+#define BinaryProtocol_h
+#include <Arduino.h>
+
+/*
+ * Compact binary alternative to the <...> text commands, for network
+ * clients that send a lot of throttle traffic (enabled by BINARY_PROTOCOL
+ * in config.h).  A client is switched to binary by sending a frame;
+ * CommandDistributor then sends it broadcasts in the same format.
+ *
+ * Frame:   START  length  opcode  params...  crc
+ *   START  is 0xA5, which can never start a text command.
+ *   length is the number of bytes in opcode and params.
+ *   params are zigzag varints (7 bits per byte, low bits first, top bit set
+ *          if more follow) so small values, positive or negative, take one byte.
+ *   crc    is CRC-8 (polynomial 0x07) of length, opcode and params.
+ *
+ * Client to command station:
+ *   OP_THROTTLE  cab speed direction   speed as <t>: -1=eStop, 0-126
+ *   OP_FUNCTION  cab function on
+ *   OP_TURNOUT   id closed
+ * A cab above 10239, function above 32767 or turnout id above 32767 is
+ * rejected with OP_ERROR, as is a frame whose params don't decode.  A frame
+ * failing its CRC is skipped without a reply.
+ * Command station to client:
+ *   OP_LOCO      cab slot speedCode functions   as <l>
+ *   OP_TURNOUT   id closed
+ *   OP_SENSOR    id active
+ *   OP_POWER     main prog join
+ *   OP_ERROR     opcode                         command rejected
+ *
+ * A frame must arrive whole, in one network read.  One cut short is
+ * answered with OP_ERROR (opcode 0 if that was cut off too), and counted
+ * for <D QUEUES>.
+ */
+
+class BinaryProtocol {
+  public:
+    static const byte FRAME_START=0xA5;
+    static const byte MAX_PARAMS=4;
+    static const byte MAX_FRAME=3+MAX_PARAMS*5+1;  // START length opcode params crc
+
+    enum : byte {
+      OP_THROTTLE=0x01,
+      OP_FUNCTION=0x02,
+      OP_TURNOUT=0x03,
+      OP_POWER=0x04,
+      OP_SENSOR=0x05,
+      OP_LOCO=0x06,
+      OP_ERROR=0x7F,
+    };
+
+    // Execute all the frames in buffer, errors are reported to stream.
+    static void parse(Print * stream, const byte * buffer, int length);
+    // Build a frame in buffer (at least MAX_FRAME bytes), returns its length.
+    static byte encode(byte * buffer, byte opcode, byte count, const int32_t params[]);
+    // Frames cut short by the end of a read
+    static unsigned int truncatedFrames;
+
+  private:
+    static bool execute(byte opcode, byte count, const int32_t p[]);
+    static void reject(Print * stream, byte opcode);
+    static byte crc8(const byte * data, byte length);
+};
+#endif
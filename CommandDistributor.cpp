@@ -28,6 +28,7 @@
 #include "defines.h"
 #include "DCCWaveform.h"
 #include "DCC.h"
+#include "CompiledFormat.h"
 
 #if defined(BIG_MEMORY) | defined(WIFI_ON) | defined(ETHERNET_ON)
 // This section of CommandDistributor is simply not relevant on a uno or similar
@@ -35,16 +36,31 @@ const byte NO_CLIENT=255;
 
 RingStream *  CommandDistributor::ring=0;
 byte CommandDistributor::ringClient=NO_CLIENT;
-CommandDistributor::clientType  CommandDistributor::clients[8]={
-  NONE_TYPE,NONE_TYPE,NONE_TYPE,NONE_TYPE,NONE_TYPE,NONE_TYPE,NONE_TYPE,NONE_TYPE};
+CommandDistributor::clientType  CommandDistributor::clients[MAX_NUM_TCP_CLIENTS]; // all NONE_TYPE
 RingStream * CommandDistributor::broadcastBufferWriter=new RingStream(100);
+#ifdef BINARY_PROTOCOL
+byte CommandDistributor::binaryBroadcast[BinaryProtocol::MAX_FRAME];
+byte CommandDistributor::binaryBroadcastLength=0;
+#endif
 
-void  CommandDistributor::parse(byte clientId,byte * buffer, RingStream * stream) {
+void  CommandDistributor::parse(byte clientId,byte * buffer, RingStream * stream, int length) {
   ring=stream;
   ringClient=stream->peekTargetMark();
+  if (clientId>=MAX_NUM_TCP_CLIENTS) {
+    DIAG(F("Client %d ignored, MAX_NUM_TCP_CLIENTS=%d"),clientId,MAX_NUM_TCP_CLIENTS);
+    ringClient=NO_CLIENT;
+    return;
+  }
   if (buffer[0] == '<')  {
     clients[clientId]=COMMAND_TYPE;
     DCCEXParser::parse(stream, buffer, ring);
+#ifdef BINARY_PROTOCOL
+  } else if (buffer[0] == BinaryProtocol::FRAME_START) {
+    clients[clientId]=BINARY_TYPE;
+    BinaryProtocol::parse(stream, buffer, length);
+#else
+    (void)length;  // only needed for binary frames
+#endif
   } else {
     clients[clientId]=WITHROTTLE_TYPE;
     WiThrottle::getThrottle(clientId)->parse(ring, buffer);
@@ -53,7 +69,7 @@ void  CommandDistributor::parse(byte clientId,byte * buffer, RingStream * stream
 }
 
 void CommandDistributor::forget(byte clientId) {
-  clients[clientId]=NONE_TYPE;
+  if (clientId<MAX_NUM_TCP_CLIENTS) clients[clientId]=NONE_TYPE;
 }
 
 
@@ -72,7 +88,17 @@ void CommandDistributor::broadcast(bool includeWithrottleClients) {
   /* loop through ring clients */
   for (byte clientId=0; clientId<sizeof(clients); clientId++) {
     if (clients[clientId]==NONE_TYPE) continue;
+#ifdef BINARY_PROTOCOL
+    if (clients[clientId]==BINARY_TYPE) {
+      if (binaryBroadcastLength==0) continue;
+      ring->mark(clientId);
+      ring->write(binaryBroadcast,binaryBroadcastLength);
+      ring->commit();
+      continue;
+    }
+#endif
     if ( clients[clientId]==WITHROTTLE_TYPE && !includeWithrottleClients) continue;
+    if ( clients[clientId]==WITHROTTLE_TYPE && WiThrottle::holdBroadcast(clientId)) continue;
     ring->mark(clientId);
     broadcastBufferWriter->printBuffer(ring);
     ring->commit();
@@ -81,7 +107,16 @@ void CommandDistributor::broadcast(bool includeWithrottleClients) {
 
 #endif
  broadcastBufferWriter->flush();
+#ifdef BINARY_PROTOCOL
+ binaryBroadcastLength=0;
+#endif
 }
+
+#ifdef BINARY_PROTOCOL
+void CommandDistributor::setBinaryBroadcast(byte opcode, byte count, const int32_t params[]) {
+  binaryBroadcastLength=BinaryProtocol::encode(binaryBroadcast, opcode, count, params);
+}
+#endif
 #else
 // For a UNO/NANO we can broadcast direct to just one Serial instead of the ring
 // Redirect ring output ditrect to Serial
@@ -93,7 +128,11 @@ void CommandDistributor::broadcast(bool includeWithrottleClients) {
 #endif
 
 void  CommandDistributor::broadcastSensor(int16_t id, bool on ) {
-  StringFormatter::send(broadcastBufferWriter,F("<%c %d>\n"), on?'Q':'q', id);
+  SEND_FORMAT(broadcastBufferWriter,"<%c %d>\n", on?'Q':'q', id);
+#ifdef BINARY_PROTOCOL
+  int32_t p[]={id, on};
+  setBinaryBroadcast(BinaryProtocol::OP_SENSOR, 2, p);
+#endif
   broadcast(false);
 }
 
@@ -101,17 +140,25 @@ void  CommandDistributor::broadcastTurnout(int16_t id, bool isClosed ) {
   // For DCC++ classic compatibility, state reported to JMRI is 1 for thrown and 0 for closed;
   // The string below contains serial and Withrottle protocols which should
   // be safe for both types.
-  StringFormatter::send(broadcastBufferWriter,F("<H %d %d>\n"),id, !isClosed);
+  SEND_FORMAT(broadcastBufferWriter,"<H %d %d>\n",id, !isClosed);
 #if defined(WIFI_ON) | defined(ETHERNET_ON)
-  StringFormatter::send(broadcastBufferWriter,F("PTA%c%d\n"), isClosed?'2':'4', id);
+  SEND_FORMAT(broadcastBufferWriter,"PTA%c%d\n", isClosed?'2':'4', id);
+#endif
+#ifdef BINARY_PROTOCOL
+  int32_t p[]={id, isClosed};
+  setBinaryBroadcast(BinaryProtocol::OP_TURNOUT, 2, p);
 #endif
   broadcast(true);
 }
 
 void  CommandDistributor::broadcastLoco(byte slot) {
   DCC::LOCO * sp=&DCC::speedTable[slot];
-  StringFormatter::send(broadcastBufferWriter,F("<l %d %d %d %l>\n"),
+  SEND_FORMAT(broadcastBufferWriter,"<l %d %d %d %l>\n",
 			sp->loco,slot,sp->speedCode,sp->functions);
+#ifdef BINARY_PROTOCOL
+  int32_t p[]={sp->loco, slot, sp->speedCode, (int32_t)sp->functions};
+  setBinaryBroadcast(BinaryProtocol::OP_LOCO, 4, p);
+#endif
   broadcast(false);
 #if defined(WIFI_ON) | defined(ETHERNET_ON)
   WiThrottle::markForBroadcast(sp->loco);
@@ -130,9 +177,13 @@ void  CommandDistributor::broadcastPower() {
   else if (prog) reason=F(" PROG");
   else state='0';
 
-  StringFormatter::send(broadcastBufferWriter,
-                        F("<p%c%S>\nPPA%c\n"),state,reason, main?'1':'0');
+  SEND_FORMAT(broadcastBufferWriter,
+                        "<p%c%S>\nPPA%c\n",state,reason, main?'1':'0');
   LCD(2,F("Power %S%S"),state=='1'?F("On"):F("Off"),reason);
+#ifdef BINARY_PROTOCOL
+  int32_t p[]={main, prog, join};
+  setBinaryBroadcast(BinaryProtocol::OP_POWER, 3, p);
+#endif
   broadcast(true);
 }
 
@@ -23,11 +23,15 @@
 #define CommandDistributor_h
 #include "DCCEXParser.h"
 #include "RingStream.h"
+#include "defines.h"
+#ifdef BINARY_PROTOCOL
+#include "BinaryProtocol.h"
+#endif
 
 class CommandDistributor {
 
 public :
-  static void parse(byte clientId,byte* buffer, RingStream * ring);
+  static void parse(byte clientId,byte* buffer, RingStream * ring, int length);
   static void broadcastLoco(byte slot);
   static void broadcastSensor(int16_t id, bool value);
   static void broadcastTurnout(int16_t id, bool isClosed);
@@ -40,9 +44,15 @@ private:
   static RingStream * broadcastBufferWriter;
   static byte ringClient;
 
-   // each bit in broadcastlist = 1<<clientid
-   enum clientType: byte {NONE_TYPE,COMMAND_TYPE,WITHROTTLE_TYPE};
-   static clientType clients[8];
+   // the protocol each network client (WiFi link id or Ethernet socket) last used
+   enum clientType: byte {NONE_TYPE,COMMAND_TYPE,WITHROTTLE_TYPE,BINARY_TYPE};
+   static clientType clients[MAX_NUM_TCP_CLIENTS];
+#ifdef BINARY_PROTOCOL
+   // broadcast encoded once for BINARY_TYPE clients, length 0 if none
+   static void setBinaryBroadcast(byte opcode, byte count, const int32_t params[]);
+   static byte binaryBroadcast[BinaryProtocol::MAX_FRAME];
+   static byte binaryBroadcastLength;
+#endif
 };
 
 #endif
@@ -144,6 +144,10 @@ void loop()
 
   Sensor::checkAll(); // Update and print changes
 
+#ifndef DISABLE_EEPROM
+  EEStore::loop();  // write any queued turnout/output states
+#endif
+
   // Report any decrease in memory (will automatically trigger on first call)
   static int ramLowWatermark = __INT_MAX__; // replaced on first loop
 
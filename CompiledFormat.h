@@ -0,0 +1,221 @@
+/*
+ *  © 2026 agent
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef CompiledFormat_h
+#define CompiledFormat_h
+#include "StringFormatter.h"
+
+/*
+ * SEND_FORMAT(stream, "format", args...) does the same as
+ *    StringFormatter::send(stream, F("format"), args...)
+ * but the format is taken apart by the compiler, for the busy broadcast paths:
+ *  - the literal text between conversions is kept in flash as separate strings,
+ *  - each conversion is a direct call for its argument, with no format
+ *    parsing or va_arg at run time,
+ *  - the number and types of the arguments are checked against the format,
+ *    so a mismatch is a build error rather than garbage on the wire.
+ *
+ * The conversions are those of StringFormatter::send, (%d %u %l %c %s %e %S %E
+ * %x %b %o %f %% with widths and - for left justify on %d %u %l).
+ * The format must be a string literal of no more than 63 characters.
+ *
+ * The compiler only has C++11, so the literal is turned into a character
+ * parameter pack by indexing it 64 times (CF_CHARS) rather than by a string
+ * template parameter.
+ */
+
+namespace CompiledFormat {
+
+  template<char... C> struct Chars {};
+
+  constexpr char charAt(const char * s, unsigned i, unsigned n) {
+    return i < n ? s[i] : '\0';
+  }
+
+  #define CF_CHARS4(s, i) CompiledFormat::charAt(s, i, sizeof(s) - 1), \
+    CompiledFormat::charAt(s, i + 1, sizeof(s) - 1), \
+    CompiledFormat::charAt(s, i + 2, sizeof(s) - 1), \
+    CompiledFormat::charAt(s, i + 3, sizeof(s) - 1)
+  #define CF_CHARS16(s, i) CF_CHARS4(s, i), CF_CHARS4(s, i + 4), CF_CHARS4(s, i + 8), CF_CHARS4(s, i + 12)
+  #define CF_CHARS(s) CF_CHARS16(s, 0), CF_CHARS16(s, 16), CF_CHARS16(s, 32), CF_CHARS16(s, 48)
+
+  // Argument type checks (no <type_traits> on AVR)
+  template<typename T> struct IsInteger { static const bool value = false; };
+  template<> struct IsInteger<bool> { static const bool value = true; };
+  template<> struct IsInteger<char> { static const bool value = true; };
+  template<> struct IsInteger<signed char> { static const bool value = true; };
+  template<> struct IsInteger<unsigned char> { static const bool value = true; };
+  template<> struct IsInteger<short> { static const bool value = true; };
+  template<> struct IsInteger<unsigned short> { static const bool value = true; };
+  template<> struct IsInteger<int> { static const bool value = true; };
+  template<> struct IsInteger<unsigned int> { static const bool value = true; };
+  template<> struct IsInteger<long> { static const bool value = true; };
+  template<> struct IsInteger<unsigned long> { static const bool value = true; };
+
+  template<typename T> struct IsInt {  // fits a %d as passed through ...
+    static const bool value = IsInteger<T>::value && sizeof(T) <= sizeof(int);
+  };
+  template<typename T> struct IsLong {
+    static const bool value = IsInteger<T>::value && sizeof(T) <= sizeof(long);
+  };
+  template<typename T> struct IsText { static const bool value = false; };
+  template<> struct IsText<char *> { static const bool value = true; };
+  template<> struct IsText<const char *> { static const bool value = true; };
+  template<typename T> struct IsFlash { static const bool value = false; };
+  template<> struct IsFlash<const FSH *> { static const bool value = true; };
+  template<typename T> struct IsFloat { static const bool value = false; };
+  template<> struct IsFloat<float> { static const bool value = true; };
+  template<> struct IsFloat<double> { static const bool value = true; };
+
+  // Literal text, one flash string per distinct piece.
+  template<char... L> struct Literal {
+    static const char text[sizeof...(L) + 1];
+    static void write(Print * stream) { StringFormatter::printFlash(stream, (const FSH *)text); }
+  };
+  template<char... L> const char Literal<L...>::text[sizeof...(L) + 1] FLASH = {L..., '\0'};
+  template<> struct Literal<> {
+    static void write(Print * stream) { (void)stream; }
+  };
+
+  // One conversion, selected by its letter.
+  template<char C, bool Left, byte Width> struct Conversion {
+    template<typename T> static void write(Print *, T) {
+      static_assert(sizeof(T) == 0, "unknown % conversion in format");
+    }
+  };
+  template<bool Left, byte Width> struct Conversion<'d', Left, Width> {
+    template<typename T> static void write(Print * stream, T value) {
+      static_assert(IsInt<T>::value, "%d needs an int sized integer");
+      StringFormatter::printPadded(stream, (int)value, Width, Left);
+    }
+  };
+  template<bool Left, byte Width> struct Conversion<'u', Left, Width> {
+    template<typename T> static void write(Print * stream, T value) {
+      static_assert(IsInt<T>::value, "%u needs an int sized integer");
+      StringFormatter::printPadded(stream, (unsigned int)value, Width, Left);
+    }
+  };
+  template<bool Left, byte Width> struct Conversion<'l', Left, Width> {
+    template<typename T> static void write(Print * stream, T value) {
+      static_assert(IsLong<T>::value, "%l needs an integer");
+      StringFormatter::printPadded(stream, (long)value, Width, Left);
+    }
+  };
+  template<bool Left, byte Width> struct Conversion<'c', Left, Width> {
+    template<typename T> static void write(Print * stream, T value) {
+      static_assert(IsInt<T>::value, "%c needs a char");
+      stream->print((char)value);
+    }
+  };
+  template<bool Left, byte Width> struct Conversion<'s', Left, Width> {
+    template<typename T> static void write(Print * stream, T value) {
+      static_assert(IsText<T>::value, "%s needs a char * (use %S for flash strings)");
+      stream->print(value);
+    }
+  };
+  template<bool Left, byte Width> struct Conversion<'e', Left, Width> {
+    template<typename T> static void write(Print * stream, T value) {
+      static_assert(IsText<T>::value, "%e needs a char * (use %E for flash strings)");
+      StringFormatter::printEscapes(stream, (char *)value);
+    }
+  };
+  template<bool Left, byte Width> struct Conversion<'S', Left, Width> {
+    template<typename T> static void write(Print * stream, T value) {
+      static_assert(IsFlash<T>::value, "%S needs a flash string (const FSH *)");
+      StringFormatter::printFlash(stream, value);
+    }
+  };
+  template<bool Left, byte Width> struct Conversion<'E', Left, Width> {
+    template<typename T> static void write(Print * stream, T value) {
+      static_assert(IsFlash<T>::value, "%E needs a flash string (const FSH *)");
+      StringFormatter::printEscapes(stream, value);
+    }
+  };
+  template<int Base> struct Based {
+    template<typename T> static void write(Print * stream, T value) {
+      static_assert(IsInt<T>::value, "%x %b %o need an int sized integer");
+      stream->print((int)value, Base);
+    }
+  };
+  template<bool Left, byte Width> struct Conversion<'x', Left, Width> : Based<HEX> {};
+  template<bool Left, byte Width> struct Conversion<'b', Left, Width> : Based<BIN> {};
+  template<bool Left, byte Width> struct Conversion<'o', Left, Width> : Based<OCT> {};
+  template<bool Left, byte Width> struct Conversion<'f', Left, Width> {
+    template<typename T> static void write(Print * stream, T value) {
+      static_assert(IsFloat<T>::value, "%f needs a float or double");
+      stream->print((double)value, 2);
+    }
+  };
+
+  // Conversion spec after the %: optional -, width digits, then the letter.
+  // Gives the Conversion and the Rest of the format after it.
+  template<bool Left, byte Width, typename Format> struct Spec;
+  template<bool Digit, bool Left, byte Width, typename Format> struct SpecStep;
+  template<bool Left, byte Width, char C, char... R> struct Spec<Left, Width, Chars<C, R...>>
+    : SpecStep<(C >= '0' && C <= '9'), Left, Width, Chars<C, R...>> {};
+  template<bool Left, byte Width, char... R> struct Spec<Left, Width, Chars<'-', R...>>
+    : Spec<true, Width, Chars<R...>> {};
+  template<bool Left, byte Width, char C, char... R> struct SpecStep<true, Left, Width, Chars<C, R...>>
+    : Spec<Left, Width * 10 + (C - '0'), Chars<R...>> {};
+  template<bool Left, byte Width, char C, char... R> struct SpecStep<false, Left, Width, Chars<C, R...>> {
+    typedef Conversion<C, Left, Width> Convert;
+    typedef Chars<R...> Rest;
+  };
+
+  // Walks the format, collecting literal characters until a conversion or
+  // the end, and sends them with the arguments.
+  template<typename Text, typename Format> struct Parser;
+
+  // Ordinary character: add to the literal
+  template<char... L, char C, char... R> struct Parser<Chars<L...>, Chars<C, R...>>
+    : Parser<Chars<L..., C>, Chars<R...>> {};
+
+  // %% is a literal %
+  template<char... L, char... R> struct Parser<Chars<L...>, Chars<'%', '%', R...>>
+    : Parser<Chars<L..., '%'>, Chars<R...>> {};
+
+  // End of format
+  template<char... L, char... R> struct Parser<Chars<L...>, Chars<'\0', R...>> {
+    static void send(Print * stream) { Literal<L...>::write(stream); }
+    template<typename... Extra> static void send(Print *, Extra...) {
+      static_assert(sizeof...(Extra) == 0, "too many arguments for format");
+    }
+  };
+
+  // Conversion: send the literal so far, then this argument, then the rest.
+  template<char... L, char... R> struct Parser<Chars<L...>, Chars<'%', R...>> {
+    typedef Spec<false, 0, Chars<R...>> S;
+    template<typename T, typename... Args> static void send(Print * stream, T value, Args... args) {
+      Literal<L...>::write(stream);
+      S::Convert::write(stream, value);
+      Parser<Chars<>, typename S::Rest>::send(stream, args...);
+    }
+    template<typename... None> static void send(Print *, None...) {
+      static_assert(sizeof...(None) != 0, "too few arguments for format");
+    }
+  };
+}
+
+#define SEND_FORMAT(stream, format, ...) do { \
+    static_assert(sizeof(format) <= 64, "SEND_FORMAT format longer than 63 characters"); \
+    CompiledFormat::Parser<CompiledFormat::Chars<>, CompiledFormat::Chars<CF_CHARS(format)>> \
+      ::send(stream, ##__VA_ARGS__); \
+  } while (0)
+
+#endif
@@ -43,6 +43,7 @@
 #include "Turnouts.h"
 #include "Sensors.h"
 #include "Outputs.h"
+#include "EEStore.h"
 #include "CommandDistributor.h"
 #include "EXRAIL.h"
     
@@ -35,9 +35,12 @@
 #include "version.h"
 #include "defines.h"
 #include "CommandDistributor.h"
+#include "SerialManager.h"
 #include "EEStore.h"
 #include "DIAG.h"
 #include "EXRAIL2.h"
+#include "ObjectPool.h"
+#include "I2CManager.h"
 #include <avr/wdt.h>
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -57,6 +60,8 @@ const int16_t HASH_KEYWORD_MAIN = 11339;
 const int16_t HASH_KEYWORD_JOIN = -30750;
 const int16_t HASH_KEYWORD_CABS = -11981;
 const int16_t HASH_KEYWORD_RAM = 25982;
+const int16_t HASH_KEYWORD_POOLS = -31953;
+const int16_t HASH_KEYWORD_QUEUES = 18402;
 const int16_t HASH_KEYWORD_CMD = 9962;
 const int16_t HASH_KEYWORD_ACK = 3113;
 const int16_t HASH_KEYWORD_ON = 2657;
@@ -82,6 +87,7 @@ const int16_t HASH_KEYWORD_T='T';
 const int16_t HASH_KEYWORD_LCN = 15137;
 const int16_t HASH_KEYWORD_HAL = 10853;
 const int16_t HASH_KEYWORD_SHOW = -21309;
+const int16_t HASH_KEYWORD_STATS = 23041;
 const int16_t HASH_KEYWORD_ANIN = -10424;
 const int16_t HASH_KEYWORD_ANOUT = -26399;
 const int16_t HASH_KEYWORD_WIFI = -5583;
@@ -848,6 +854,20 @@ bool DCCEXParser::parseD(Print *stream, int16_t params, int16_t p[])
         StringFormatter::send(stream, F("Free memory=%d\n"), minimumFreeMemory());
         break;
 
+    case HASH_KEYWORD_POOLS: // <D POOLS>
+        ObjectPool::printAll(stream);
+        break;
+
+    case HASH_KEYWORD_QUEUES: // <D QUEUES>
+        DCCWaveform::mainTrack.printQueue(stream, F("MAIN packet"));
+        DCCWaveform::progTrack.printQueue(stream, F("PROG packet"));
+        I2CManager.printQueue(stream);
+        SerialManager::printQueues(stream);
+#ifdef BINARY_PROTOCOL
+        StringFormatter::send(stream, F("Binary frames truncated=%d\n"), BinaryProtocol::truncatedFrames);
+#endif
+        break;
+
     case HASH_KEYWORD_ACK: // <D ACK ON/OFF> <D ACK [LIMIT|MIN|MAX|RETRY] Value>
 	if (params >= 3) {
 	    if (p[1] == HASH_KEYWORD_LIMIT) {
@@ -932,6 +952,8 @@ bool DCCEXParser::parseD(Print *stream, int16_t params, int16_t p[])
     case HASH_KEYWORD_HAL: 
         if (p[1] == HASH_KEYWORD_SHOW) 
           IODevice::DumpAll();
+        else if (p[1] == HASH_KEYWORD_STATS)  // <D HAL STATS>
+          IODevice::DumpStats();
         break;
 #endif
 
@@ -97,7 +97,6 @@ const byte bitMask[] = {0x00, 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01};
 
 DCCWaveform::DCCWaveform( byte preambleBits, bool isMain) {
   isMainTrack = isMain;
-  packetPending = false;
   memcpy(transmitPacket, idlePacket, sizeof(idlePacket));
   state = WAVE_START;
   // The +1 below is to allow the preamble generator to create the stop bit
@@ -240,15 +239,15 @@ void DCCWaveform::interrupt2() {
       if (transmitRepeats > 0) {
         transmitRepeats--;
       }
-      else if (packetPending) {
-        // Copy pending packet to transmit packet
+      else if (!packetQueue.empty()) {
+        // Copy next queued packet to transmit packet
         // a fixed length memcpy is faster than a variable length loop for these small lengths
-        // for (int b = 0; b < pendingLength; b++) transmitPacket[b] = pendingPacket[b];
-        memcpy( transmitPacket, pendingPacket, sizeof(pendingPacket));
+        DCCPacket * packet = packetQueue.front();
+        memcpy( transmitPacket, packet->data, sizeof(transmitPacket));
         
-        transmitLength = pendingLength;
-        transmitRepeats = pendingRepeats;
-        packetPending = false;
+        transmitLength = packet->length;
+        transmitRepeats = packet->repeats;
+        packetQueue.pop();
         sentResetsSincePacket=0;
       }
       else {
@@ -264,21 +263,22 @@ void DCCWaveform::interrupt2() {
 #pragma GCC pop_options
 
 
-// Wait until there is no packet pending, then make this pending
+// Queue a packet for the interrupt, waiting only if the queue is full.
 void DCCWaveform::schedulePacket(const byte buffer[], byte byteCount, byte repeats) {
   if (byteCount > MAX_PACKET_SIZE) return; // allow for chksum
-  while (packetPending);
 
+  DCCPacket packet;
   byte checksum = 0;
   for (byte b = 0; b < byteCount; b++) {
     checksum ^= buffer[b];
-    pendingPacket[b] = buffer[b];
+    packet.data[b] = buffer[b];
   }
-  // buffer is MAX_PACKET_SIZE but pendingPacket is one bigger
-  pendingPacket[byteCount] = checksum;
-  pendingLength = byteCount + 1;
-  pendingRepeats = repeats;
-  packetPending = true;
+  // buffer is MAX_PACKET_SIZE but packet.data is one bigger
+  packet.data[byteCount] = checksum;
+  packet.length = byteCount + 1;
+  packet.repeats = repeats;
+  while (packetQueue.full()) yield();  // the interrupt takes one at the end of each transmission
+  packetQueue.push(packet);
   sentResetsSincePacket=0;
 }
 
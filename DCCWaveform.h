@@ -25,6 +25,7 @@
 #define DCCWaveform_h
 
 #include "MotorDriver.h"
+#include "SPSCRing.h"
 
 // Wait times for power management. Unit: milliseconds
 const int  POWER_SAMPLE_ON_WAIT = 100;
@@ -35,6 +36,7 @@ const int  POWER_SAMPLE_OVERLOAD_WAIT = 20;
 const int   PREAMBLE_BITS_MAIN = 16;
 const int   PREAMBLE_BITS_PROG = 22;
 const byte   MAX_PACKET_SIZE = 5;  // NMRA standard extended packets, payload size WITHOUT checksum.
+const byte   PACKET_QUEUE_SIZE = 4;  // packets waiting for the interrupt, per track (power of 2).
 
 // The WAVE_STATE enum is deliberately numbered because a change of order would be catastrophic
 // to the transform array.
@@ -85,7 +87,8 @@ class DCCWaveform {
       return tripmA;        
     }
     void schedulePacket(const byte buffer[], byte byteCount, byte repeats);
-    volatile bool packetPending;
+    inline bool packetPending() { return !packetQueue.empty(); }
+    inline void printQueue(Print * stream, const FSH * name) { packetQueue.print(stream, name); }
     volatile byte sentResetsSincePacket;
     volatile bool autoPowerOff=false;
     void setAckBaseline();  //prog track only
@@ -135,9 +138,13 @@ class DCCWaveform {
     byte bits_sent;           // 0-8 (yes 9 bits) sent for current byte
     byte bytes_sent;          // number of bytes sent from transmitPacket
     WAVE_STATE state;         // wave generator state machine
-    byte pendingPacket[MAX_PACKET_SIZE+1]; // +1 for checksum
-    byte pendingLength;
-    byte pendingRepeats;
+    // Packets queued by schedulePacket for the interrupt to send in turn.
+    struct DCCPacket {
+      byte data[MAX_PACKET_SIZE+1]; // +1 for checksum
+      byte length;
+      byte repeats;
+    };
+    SPSCRing<DCCPacket, PACKET_QUEUE_SIZE> packetQueue;
     int  lastCurrent;
     static int progTripValue;
     int maxmA;
@@ -56,15 +56,294 @@ void EEStore::init() {
     EEPROM.put(0, eeStore->data);
   }
 
+  unsigned long startTime = millis();
+  bool logFound = findLog();  // bring turnout and output states up to date
   reset();          // set memory pointer to first free EEPROM space
   Turnout::load();  // load turnout definitions
   Sensor::load();   // load sensor definitions
   Output::load();   // load output definitions
+  DIAG(F("EEPROM loaded %d turnouts, %d sensors, %d outputs in %lms"),
+    eeStore->data.nTurnouts, eeStore->data.nSensors, eeStore->data.nOutputs, 
+    millis() - startTime);
+
+  // Only now is the end of the definitions known, so only now may the 
+  // ring be created, as it may hold definitions from before there was a log.
+  if (logSlots() == 0) return;
+  if (pointer() > logBase()) {
+    DIAG(F("EEPROM state log disabled, definitions overlap it"));
+    logEnabled = false;
+  }
+  else if (!logFound) {
+    if (loadIncomplete) DIAG(F("EEPROM state log not created, definitions not all loaded"));
+    else createLog();
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  State log.
+//
+//  The log occupies the top logSize() bytes of EEPROM: a LogHeader 
+//  followed by a ring of LogRecord slots.  putState appends a record at the 
+//  next slot, so the writes move round the whole ring rather than wearing
+//  out one byte.  The records of the current epoch form a single run of 
+//  consecutive sequence numbers, and at startup the run is found and 
+//  replayed into the definitions in order.  Only bytes that differ are 
+//  written.
+//
+//  When the ring is full the run is copied into place and a new epoch
+//  started at the current slot, which invalidates every existing record.
+//  <E> and <e> do the same, because they rewrite the state bytes anyway.
+//
+//  The log is never created, and so the ring never erased, while the 
+//  definitions reach into it; state bytes are then written in place.
+///////////////////////////////////////////////////////////////////////////////
+
+int EEStore::logSize() { 
+  int size = EEPROM.length() / 8;
+  return (EESTORE_LOG_SIZE < size) ? EESTORE_LOG_SIZE : size; 
+}
+
+int EEStore::logBase() { return EEPROM.length() - logSize(); }
+
+uint16_t EEStore::logSlots() { 
+  if (logSize() < (int)sizeof(LogHeader)) return 0;
+  return (logSize() - sizeof(LogHeader)) / sizeof(LogRecord); 
+}
+
+int EEStore::slotAddress(uint16_t slot) {
+  return logBase() + sizeof(LogHeader) + slot * sizeof(LogRecord);
+}
+
+uint8_t EEStore::recordCheck(LogRecord &rec) {
+  uint8_t crc = logHeader.epoch;
+  for (uint8_t i = 0; i < offsetof(LogRecord, check); i++) {
+    crc ^= ((uint8_t *)&rec)[i];
+    for (uint8_t bit = 0; bit < 8; bit++)
+      crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+  }
+  return crc;
+}
+
+// Read record from slot, returns true if it belongs to this epoch.
+bool EEStore::readRecord(uint16_t slot, LogRecord &rec) {
+  EEPROM.get(slotAddress(slot), rec);
+  return rec.seq != 0xFFFF && rec.check == recordCheck(rec) 
+      && rec.address < (uint16_t)logBase();
+}
+
+// Find the run of records of this epoch and replay them, if there is a log.
+bool EEStore::findLog() {
+  logEnabled = false;
+  if (logSlots() == 0) return false;
+  EEPROM.get(logBase(), logHeader);
+  if (strncmp(logHeader.id, EESTORE_LOG_ID, sizeof(logHeader.id)) != 0 
+      || logHeader.start >= logSlots()) return false;
+  logEnabled = true;
+
+  // The run starts at logHeader.start and continues for as long as 
+  // the sequence numbers follow on.
+  LogRecord rec;
+  logHead = logHeader.start;
+  logCount = 0;
+  logSeq = 0;
+  if (readRecord(logHead, rec)) {
+    logSeq = rec.seq;
+    do {
+      logCount++;
+      logSeq = (rec.seq == 0xFFFE) ? 0 : rec.seq + 1;
+      logHead = (logHead + 1) % logSlots();
+    } while (logCount < logSlots() && readRecord(logHead, rec) && rec.seq == logSeq);
+  }
+  replayLog();
+  DIAG(F("EEPROM state log: %d/%d records"), logCount, logSlots());
+  return true;
+}
+
+// Erase the ring, in case it holds anything that looks like a record, and 
+// write the header.  The definitions must be clear of it.
+void EEStore::createLog() {
+  DIAG(F("EEPROM state log created"));
+  for (int a = logBase() + sizeof(LogHeader); a < (int)EEPROM.length(); a++) 
+    if (EEPROM.read(a) != 0xFF) EEPROM.write(a, 0xFF);
+  memcpy(logHeader.id, EESTORE_LOG_ID, sizeof(logHeader.id));
+  logHeader.epoch = 0;
+  logHeader.start = 0;
+  EEPROM.put(logBase(), logHeader);
+  logHead = 0;
+  logCount = 0;
+  logSeq = 0;
+  logEnabled = true;
+}
+
+// True if a later record of this epoch is for the same address, so that
+// record i need not be written into place.  A turnout changed back and forth
+// would otherwise have its byte written once per record.
+bool EEStore::superseded(uint16_t i, uint16_t address) {
+  for (uint16_t j = i + 1; j < logCount; j++) {
+    uint16_t later;
+    EEPROM.get(slotAddress((logHeader.start + j) % logSlots()) + offsetof(LogRecord, address), later);
+    if (later == address) return true;
+  }
+  return false;
+}
+
+// Write the latest record of this epoch for each address into place. 
+void EEStore::replayLog() {
+  LogRecord rec;
+  for (uint16_t i = 0; i < logCount; i++) {
+    EEPROM.get(slotAddress((logHeader.start + i) % logSlots()), rec);
+    if (!superseded(i, rec.address) && EEPROM.read(rec.address) != rec.value) 
+      EEPROM.write(rec.address, rec.value);
+  }
+}
+
+// Start a new epoch at the current head, discarding all records.
+void EEStore::newEpoch() {
+  if (!logEnabled) return;
+  logHeader.epoch++;
+  logHeader.start = logHead;
+  logCount = 0;
+  EEPROM.put(logBase(), logHeader);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  Write-behind queue.
+//
+//  An EEPROM byte write takes about 3.3ms on AVR, so state changes are
+//  queued by putState and written by loop() EESTORE_WRITES_PER_LOOP bytes
+//  per call at most, and only when the EEPROM has finished the previous 
+//  byte, so loop() never waits for the EEPROM.  A change to an
+//  address that is already queued just replaces the queued value.
+//  If the queue is full, or on <E>, <e> and similar, the queue is flushed
+//  by waiting for each write in turn.
+///////////////////////////////////////////////////////////////////////////////
+
+// Record a new value for a turnout or output state byte.
+void EEStore::putState(int address, byte value) {
+  for (uint8_t i = 0; i < queueCount; i++) {
+    if (queue[i].address == address) {
+      queue[i].value = value;
+      return;
+    }
+  }
+  while (queueCount == EESTORE_QUEUE_SIZE) {
+    // No room, so finish the current write the hard way and start the next.
+    while (writeNextByte(true)) {}
+    startWrite();
+  }
+  queue[queueCount].address = address;
+  queue[queueCount].value = value;
+  queueCount++;
+}
+
+// Prepare the bytes to be written next: a record being copied into place 
+// while the ring is compacted, the new header at the end of compaction, 
+// or the oldest queued entry.
+bool EEStore::startWrite() {
+  writeIndex = 0;
+  if (compacting) {
+    if (compactIndex < logCount) {
+      LogRecord rec;
+      EEPROM.get(slotAddress((logHeader.start + compactIndex) % logSlots()), rec);
+      compactIndex++;
+      writeAddress = rec.address;
+      writeBuffer[0] = rec.value;
+      // A record replaced by a later one is passed over with nothing to 
+      // write, and loop() goes no further that call, so it scans the run 
+      // at most once for each byte it writes.
+      writeLength = superseded(compactIndex - 1, rec.address) ? 0 : 1;
+      return true;
+    }
+    // All copied, so start a new epoch.  The epoch byte is written before 
+    // the start slot, so an interrupted header write finds no records.
+    compacting = false;
+    logHeader.epoch++;
+    logHeader.start = logHead;
+    logCount = 0;
+    memcpy(writeBuffer, &logHeader, sizeof(logHeader));
+    writeAddress = logBase();
+    writeLength = sizeof(logHeader);
+    return true;
+  }
+
+  if (queueCount == 0) return false;
+  if (logEnabled && logCount == logSlots()) {
+    // Ring full, so bring the definitions up to date a byte at a time and start again.
+    compacting = true;
+    compactIndex = 0;
+    return startWrite();
+  }
+  QueueEntry entry = queue[0];
+  queueCount--;
+  memmove(&queue[0], &queue[1], queueCount * sizeof(QueueEntry));
+
+  if (!logEnabled) {
+    writeAddress = entry.address;
+    writeBuffer[0] = entry.value;
+    writeLength = 1;
+    return true;
+  }
+  LogRecord rec;
+  rec.seq = logSeq;
+  rec.address = entry.address;
+  rec.value = entry.value;
+  rec.check = recordCheck(rec);
+  memcpy(writeBuffer, &rec, sizeof(rec));
+  writeAddress = slotAddress(logHead);
+  writeLength = sizeof(rec);
+  logHead = (logHead + 1) % logSlots();
+  logCount++;
+  logSeq = (logSeq == 0xFFFE) ? 0 : logSeq + 1;
+  return true;
+}
+
+// Write the next byte of the current entry, if the EEPROM is ready or wait is set.
+// Returns true if there are more bytes to write.
+bool EEStore::writeNextByte(bool wait) {
+  while (writeIndex < writeLength) {
+    if (!wait && !eepromReady()) return true;
+    int address = writeAddress + writeIndex;
+    uint8_t value = writeBuffer[writeIndex++];
+    if (EEPROM.read(address) != value) {
+      EEPROM.write(address, value);
+      return writeIndex < writeLength;
+    }
+    // Byte unchanged, so go straight on to the next.
+  }
+  return false;
+}
+
+bool EEStore::eepromReady() {
+#if defined(ARDUINO_ARCH_AVR) || defined(ARDUINO_ARCH_MEGAAVR)
+  return eeprom_is_ready();
+#else
+  return true;
+#endif
+}
+
+// Called from the main loop to write at most EESTORE_WRITES_PER_LOOP bytes.
+void EEStore::loop() {
+  for (uint8_t n = 0; n < EESTORE_WRITES_PER_LOOP; n++) {
+    if (writeIndex >= writeLength) {
+      if (!startWrite()) return;
+      if (writeLength == 0) return;  // superseded record passed over
+    }
+    if (!eepromReady()) return;
+    writeNextByte(false);
+  }
+}
+
+// Write everything that is queued, waiting as necessary.
+void EEStore::flush() {
+  do {
+    while (writeNextByte(true)) {}
+  } while (startWrite());
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
 void EEStore::clear() {
+  flush();
   sprintf(eeStore->data.id,
           EESTORE_ID);  // create blank eeStore structure (no turnouts, no
                         // sensors) and save it back to EEPROM
@@ -72,16 +351,27 @@ void EEStore::clear() {
   eeStore->data.nSensors = 0;
   eeStore->data.nOutputs = 0;
   EEPROM.put(0, eeStore->data);
+  newEpoch();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
 void EEStore::store() {
+  flush();
+  // The records are no longer needed, and their addresses may be about to
+  // change.  Start the new epoch first, so that if the definitions now reach
+  // into the ring nothing there is taken for a record at the next startup.
+  newEpoch();
   reset();
   Turnout::store();
   Sensor::store();
   Output::store();
   EEPROM.put(0, eeStore->data);
+  if (pointer() > logBase()) {
+    if (logEnabled) DIAG(F("EEPROM state log disabled, definitions overlap it"));
+    logEnabled = false;
+  }
+  else if (!logEnabled && logSlots() > 0) createLog();
   DIAG(F("EEPROM used: %d/%d bytes"), EEStore::pointer(), EEPROM.length());
 }
 
@@ -99,6 +389,7 @@ int EEStore::pointer() { return (eeAddress); }
 
 void EEStore::dump(int num) {
   byte b;
+  flush();
   DIAG(F("Addr  0x  char"));
   for (int n = 0; n < num; n++) {
     EEPROM.get(n, b);
@@ -109,4 +400,18 @@ void EEStore::dump(int num) {
 
 EEStore *EEStore::eeStore = NULL;
 int EEStore::eeAddress = 0;
+bool EEStore::loadIncomplete = false;
+bool EEStore::logEnabled = false;
+EEStore::LogHeader EEStore::logHeader;
+uint16_t EEStore::logHead = 0;
+uint16_t EEStore::logCount = 0;
+uint16_t EEStore::logSeq = 0;
+EEStore::QueueEntry EEStore::queue[EESTORE_QUEUE_SIZE];
+uint8_t EEStore::queueCount = 0;
+uint8_t EEStore::writeBuffer[sizeof(LogRecord)];
+uint16_t EEStore::writeAddress = 0;
+uint8_t EEStore::writeLength = 0;
+uint8_t EEStore::writeIndex = 0;
+bool EEStore::compacting = false;
+uint16_t EEStore::compactIndex = 0;
 #endif
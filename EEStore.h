@@ -35,6 +35,25 @@ extern ExternalEEPROM EEPROM;
 
 #define EESTORE_ID "DCC++1"
 
+// Bytes at the top of EEPROM reserved for the turnout/output state log,
+// limited to an eighth of the EEPROM (128 bytes on a 1KB Uno or Nano).
+// Set to 0 to write state changes in place as before.
+#ifndef EESTORE_LOG_SIZE
+#define EESTORE_LOG_SIZE 256
+#endif
+#define EESTORE_LOG_ID "SL"
+
+// State changes waiting to be written to EEPROM by EEStore::loop().
+#ifndef EESTORE_QUEUE_SIZE
+#define EESTORE_QUEUE_SIZE 16
+#endif
+
+// Most bytes EEStore::loop() writes in one call.  An AVR EEPROM is busy for 
+// about 3.3ms after each byte, so more only helps where it is emulated.
+#ifndef EESTORE_WRITES_PER_LOOP
+#define EESTORE_WRITES_PER_LOOP 1
+#endif
+
 struct EEStoreData{
   char id[sizeof(EESTORE_ID)];
   uint16_t nTurnouts;
@@ -46,6 +65,7 @@ struct EEStore{
   static EEStore *eeStore;
   EEStoreData data;
   static int eeAddress;
+  static bool loadIncomplete;  // a definition was not loaded, so pointer() may be short of their end
   static void init();
   static void reset();
   static int pointer();
@@ -53,6 +73,59 @@ struct EEStore{
   static void store();
   static void clear();
   static void dump(int);
+  static void putState(int address, byte value);
+  static void loop();
+  static void flush();
+
+private:
+  // Turnout closed flags and Output status bytes change often, so rather
+  // than rewriting them in place each change is appended to a circular log 
+  // at the top of EEPROM.  See EEStore.cpp.
+  struct LogHeader {
+    char id[sizeof(EESTORE_LOG_ID)-1];
+    uint8_t epoch;    // records from other epochs are invalid
+    uint16_t start;   // slot of first record in this epoch
+  };
+  struct LogRecord {
+    uint16_t seq;     // consecutive within an epoch, never 0xFFFF
+    uint16_t address; // EEPROM address of the state byte
+    uint8_t value;
+    uint8_t check;    // crc of the above and the epoch
+  };
+  static bool logEnabled;    // log found or created, and clear of the definitions
+  static LogHeader logHeader;
+  static uint16_t logHead;   // slot for next record
+  static uint16_t logCount;  // records in this epoch
+  static uint16_t logSeq;    // seq for next record
+  static int logSize();
+  static int logBase();
+  static uint16_t logSlots();
+  static int slotAddress(uint16_t slot);
+  static bool readRecord(uint16_t slot, LogRecord &rec);
+  static uint8_t recordCheck(LogRecord &rec);
+  static bool findLog();
+  static void createLog();
+  static bool superseded(uint16_t i, uint16_t address);
+  static void replayLog();
+  static void newEpoch();
+
+  // Write-behind queue of state changes, one entry per address.
+  struct QueueEntry {
+    uint16_t address;
+    uint8_t value;
+  };
+  static QueueEntry queue[EESTORE_QUEUE_SIZE];
+  static uint8_t queueCount;
+  // Bytes of the entry currently being written, one per loop() call.
+  static uint8_t writeBuffer[sizeof(LogRecord)];  // a LogRecord or LogHeader
+  static uint16_t writeAddress;
+  static uint8_t writeLength;
+  static uint8_t writeIndex;
+  static bool compacting;       // copying log records into place
+  static uint16_t compactIndex; // next record to copy
+  static bool startWrite();
+  static bool writeNextByte(bool wait);
+  static bool eepromReady();
 };
 
 #endif
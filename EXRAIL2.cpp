@@ -49,6 +49,7 @@
 #include "DCCEXParser.h"
 #include "Turnouts.h"
 #include "CommandDistributor.h"
+#include "ObjectPool.h"
 
 
 // Command parsing keywords
@@ -88,6 +89,12 @@ LookList *  RMFT2::onCloseLookup=NULL;
 LookList *  RMFT2::onActivateLookup=NULL;
 LookList *  RMFT2::onDeactivateLookup=NULL;
 
+// Tasks come and go all the time, so are allocated from a pool.
+static const char taskPoolName[] FLASH = "Task";
+static ObjectPool taskPool((const FSH *)taskPoolName, sizeof(RMFT2), 8);
+void * RMFT2::operator new(size_t size) { return taskPool.allocate(size); }
+void RMFT2::operator delete(void * object) { taskPool.release(object); }
+
 #define GET_OPCODE GETFLASH(RMFT2::RouteCode+progCounter)
 #define GET_OPERAND(n) GETFLASHW(RMFT2::RouteCode+progCounter+1+(n*3))
 #define SKIPOP progCounter+=3
@@ -101,6 +101,8 @@ class LookList {
     RMFT2(int progCounter);
     RMFT2(int route, uint16_t cab);
     ~RMFT2();
+    static void *operator new(size_t size);
+    static void operator delete(void *object);
     static void readLocoCallback(int16_t cv);
     static void createNewTask(int route, uint16_t cab);
     static void turnoutEvent(int16_t id, bool closed);  
@@ -26,6 +26,7 @@
 #include "EthernetInterface.h"
 #include "DIAG.h"
 #include "CommandDistributor.h"
+#include "WiThrottle.h"
 #include "DCCTimer.h"
 
 EthernetInterface * EthernetInterface::singleton=NULL;
@@ -92,6 +93,7 @@ EthernetInterface::EthernetInterface()
     LCD(5,F("Port:%d"), IP_PORT);
 
     outboundRing=new RingStream(OUTBOUND_RING_SIZE);     
+    nextSocket=0;
 }
 
 /**
@@ -146,12 +148,23 @@ void EthernetInterface::loop()
                 break;
             }
         }
-        if (socket==MAX_SOCK_NUM) DIAG(F("new Ethernet OVERFLOW")); 
+        if (socket==MAX_SOCK_NUM) {
+          DIAG(F("new Ethernet OVERFLOW"));
+          client.stop();
+        }
     }
 
-    // check for incoming data from all possible clients
-    for (byte socket = 0; socket < MAX_SOCK_NUM; socket++)
+    // check for incoming data from all possible clients.
+    // Each socket gets one read per pass, starting after the last socket read,
+    // so a busy client cannot hold up the others. Stop when the time budget
+    // is used up or there may not be room for the replies.
+    unsigned long startTime=micros();
+    for (byte tries = 0; tries < MAX_SOCK_NUM; tries++)
     {
+        if (micros()-startTime > ETH_LOOP_BUDGET) break;
+        if (outboundRing->freeSpace() < MAX_ETH_BUFFER) break;
+        byte socket=nextSocket;
+        nextSocket=(nextSocket+1) % MAX_SOCK_NUM;
         if (clients[socket]) {
         
         int available=clients[socket].available();
@@ -159,13 +172,13 @@ void EthernetInterface::loop()
             if (Diag::ETHERNET)  DIAG(F("Ethernet: available socket=%d,avail=%d"), socket, available);
             // read bytes from a client
             int count = clients[socket].read(buffer, MAX_ETH_BUFFER);
+            if (count<=0) continue;
             buffer[count] = '\0'; // terminate the string properly
             if (Diag::ETHERNET) DIAG(F(",count=%d:%e"), socket,buffer);
             // execute with data going directly back
             outboundRing->mark(socket); 
-            CommandDistributor::parse(socket,buffer,outboundRing);
+            CommandDistributor::parse(socket,buffer,outboundRing,count);
             outboundRing->commit();
-            return; // limit the amount of processing that takes place within 1 loop() cycle. 
           }
         }
     }
@@ -179,13 +192,26 @@ void EthernetInterface::loop()
      }
     }
     
-    // handle at most 1 outbound transmission 
-    int socketOut=outboundRing->read();
-    if (socketOut>=0) {
+    WiThrottle::loop(outboundRing);
+
+    sendReplies(startTime);
+}
+
+// Send replies from the outbound ring until it is empty or the time budget is used up.
+// Consecutive replies to the same socket are written as blocks and flushed once.
+void EthernetInterface::sendReplies(unsigned long startTime) {
+  do {
+    int socketOut=outboundRing->peek(0);
+    if (socketOut<0) return;
+    bool live = socketOut<MAX_SOCK_NUM && clients[socketOut];
+    while (outboundRing->peek(0)==socketOut) {
+      outboundRing->read();  // socket 
       int count=outboundRing->count();
       if (Diag::ETHERNET) DIAG(F("Ethernet reply socket=%d, count=:%d"), socketOut,count);
-      for(;count>0;count--)  clients[socketOut].write(outboundRing->read());
-      clients[socketOut].flush(); //maybe 
+      if (live) outboundRing->transfer(&clients[socketOut],count);
+      else for(;count>0;count--) outboundRing->read(); // client gone, discard 
     }
+    if (live) clients[socketOut].flush(); //maybe 
+  } while (micros()-startTime <= ETH_LOOP_BUDGET);
 }
 #endif
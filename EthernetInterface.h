@@ -47,6 +47,9 @@
 
 #define MAX_ETH_BUFFER 512
 #define OUTBOUND_RING_SIZE 2048
+#ifndef ETH_LOOP_BUDGET
+ #define ETH_LOOP_BUDGET 2000  // microseconds of socket reads/writes per loop() call
+#endif
 
 class EthernetInterface {
 
@@ -60,10 +63,12 @@ class EthernetInterface {
      bool connected;
      EthernetInterface();
      void loop2();
+     void sendReplies(unsigned long startTime);
     EthernetServer * server;
     EthernetClient clients[MAX_SOCK_NUM];                // accept up to MAX_SOCK_NUM client connections at the same time; This depends on the chipset used on the Shield
     uint8_t buffer[MAX_ETH_BUFFER+1];                    // buffer used by TCP for the recv
     RingStream * outboundRing;
+    byte nextSocket;                                     // next socket to read, round robin
   
 };
 
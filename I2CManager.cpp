@@ -22,7 +22,9 @@
 #include "DIAG.h"
 
 // Include target-specific portions of I2CManager class
-#if defined(I2C_USE_WIRE) 
+#if defined(I2C_USE_SIMULATION)
+#include "I2CManager_Sim.h"       // Simulated bus
+#elif defined(I2C_USE_WIRE) 
 #include "I2CManager_Wire.h"
 #elif defined(ARDUINO_ARCH_AVR)
 #include "I2CManager_NonBlocking.h"
@@ -44,6 +46,10 @@ void I2CManagerClass::begin(void) {
     _initialise();
 
     // Probe and list devices.
+#if defined(DIAG_HALSTATS)
+    I2CStats *savedContext = statsContext;
+    statsContext = NULL;  // Don't count the probes against the calling device
+#endif
     bool found = false;
     for (byte addr=1; addr<127; addr++) {
       if (exists(addr)) {
@@ -52,6 +58,9 @@ void I2CManagerClass::begin(void) {
       }
     }
     if (!found) DIAG(F("No I2C Devices found"));
+#if defined(DIAG_HALSTATS)
+    statsContext = savedContext;
+#endif
   }
 }
 
@@ -147,6 +156,24 @@ uint8_t I2CManagerClass::finishRB(I2CRB *rb, uint8_t status) {
   return status;
 }
 
+#if defined(DIAG_HALSTATS)
+/***************************************************************************
+ * Count a request against the current statistics context, and remember the 
+ * context so that the completion status can be counted against it too.
+ ***************************************************************************/
+void I2CManagerClass::countRequest(I2CRB *rb) {
+  rb->stats = statsContext;
+  if (statsContext) statsContext->bytes += rb->writeLen + rb->readLen;
+}
+
+/***************************************************************************
+ * Count an error on completion of a request (may be called from ISR).
+ ***************************************************************************/
+void I2CManagerClass::countCompletion(I2CRB *rb) {
+  if (rb->status != I2C_STATUS_OK && rb->stats) rb->stats->errors++;
+}
+#endif
+
 /***************************************************************************
  * Get a message corresponding to the error status
  ***************************************************************************/
@@ -22,6 +22,7 @@
 
 #include <inttypes.h>
 #include "FSH.h"
+#include "SPSCRing.h"
 
 /* 
  * Manager for I2C communications.  For portability, it allows use 
@@ -116,11 +117,30 @@
 // Uncomment following line to disable the use of interrupts by the native I2C drivers.
 //#define I2C_NO_INTERRUPTS
 
+// Uncomment following line to replace the I2C bus with a simulated bus containing
+// models of common I2C devices (see I2CSimulator.h).
+//#define I2C_USE_SIMULATION
+
+// The simulated bus executes requests synchronously, like the Wire implementation.
+#if defined(I2C_USE_SIMULATION) && !defined(I2C_USE_WIRE)
+#define I2C_USE_WIRE
+#endif
+
+// Define symbol DIAG_HALSTATS to count the I2C bytes transferred and errors for each HAL 
+// device.  As it changes the I2CRB structure, it must be defined in the build flags 
+// (e.g. -DDIAG_HALSTATS) so that all modules are compiled consistently.
+
 // Default to use interrupts within the native I2C drivers.
 #ifndef I2C_NO_INTERRUPTS
 #define I2C_USE_INTERRUPTS
 #endif
 
+// Maximum number of requests waiting for the native I2C drivers (power of 2).
+// Each device has its own request block, so this only fills on a busy bus.
+#ifndef I2C_QUEUE_SIZE
+#define I2C_QUEUE_SIZE 16
+#endif
+
 // Status codes for I2CRB structures.
 enum : uint8_t {
   // Codes used by Wire and by native drivers
@@ -159,6 +179,14 @@ typedef enum : uint8_t
 #define I2C_FREQ    400000L
 #endif
 
+#if defined(DIAG_HALSTATS)
+// Statistics accumulated for a user of the I2C manager, e.g. a HAL device.
+struct I2CStats {
+  unsigned long bytes;  // Bytes written and read
+  unsigned int errors;  // Requests completed with an error status
+};
+#endif
+
 // Class defining a request context for an I2C operation.
 class I2CRB {
 public:
@@ -179,8 +207,8 @@ public:
   uint8_t i2cAddress;
   uint8_t *readBuffer;
   const uint8_t *writeBuffer;
-#if !defined(I2C_USE_WIRE)
-  I2CRB *nextRequest;
+#if defined(DIAG_HALSTATS)
+  I2CStats *stats;  // Statistics context at the time the request was queued.
 #endif
 };
 
@@ -216,6 +244,8 @@ public:
   uint8_t read(uint8_t address, uint8_t readBuffer[], uint8_t readSize, 
     uint8_t writeSize, ...);
   void queueRequest(I2CRB *req);
+  // Report request queue usage for <D QUEUES>
+  void printQueue(Print *stream);
 
   // Function to abort long-running operations.
   void checkForTimeout();
@@ -227,6 +257,14 @@ public:
   // need to be printed using FSH.
   static const FSH *getErrorMessage(uint8_t status);
 
+#if defined(DIAG_HALSTATS)
+  // Statistics context.  Requests queued while this is set are counted against 
+  // it, as are any errors when they complete.
+  I2CStats *statsContext = NULL;
+  void countRequest(I2CRB *rb);
+  static void countCompletion(I2CRB *rb);
+#endif
+
 private:
   bool _beginCompleted = false;
   bool _clockSpeedFixed = false;
@@ -239,16 +277,10 @@ private:
   void _setClock(unsigned long);
 
 #if !defined(I2C_USE_WIRE)
-    // I2CRB structs are queued on the following two links.
-    // If there are no requests, both are NULL.
-    // If there is only one request, then queueHead and queueTail both point to it.
-    // Otherwise, queueHead is the pointer to the first request in the queue and
-    // queueTail is the pointer to the last request in the queue.
-    // Within the queue, each request's nextRequest field points to the 
-    // next request, or NULL.
-    // Mark volatile as they are updated by IRC and read/written elsewhere.
-    static I2CRB * volatile queueHead;
-    static I2CRB * volatile queueTail;
+    // I2CRB structs are queued here by queueRequest.  The request at the 
+    // front is the one in progress (currentRequest), and is removed by the
+    // interrupt handler when it completes.
+    static SPSCRing<I2CRB *, I2C_QUEUE_SIZE> queue;
     static volatile uint8_t state;
 
     static I2CRB * volatile currentRequest;
@@ -40,7 +40,6 @@
  ***************************************************************************/
 void I2CManagerClass::_initialise()
 {
-  queueHead = queueTail = NULL;
   state = I2C_STATE_FREE;
   I2C_init();
 }
@@ -59,9 +58,9 @@ void I2CManagerClass::_setClock(unsigned long i2cClockSpeed) {
  ***************************************************************************/
 void I2CManagerClass::startTransaction() { 
   ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
-    if ((state == I2C_STATE_FREE) && (queueHead != NULL)) {
+    if ((state == I2C_STATE_FREE) && !queue.empty()) {
       state = I2C_STATE_ACTIVE;
-      currentRequest = queueHead;
+      currentRequest = *queue.front();
       rxCount = txCount = 0;
       // Copy key fields to static data for speed.
       operation = currentRequest->operation;
@@ -74,19 +73,31 @@ void I2CManagerClass::startTransaction() {
 
 /***************************************************************************
  *  Function to queue a request block and initiate operations.
+ *  The queue is only added to here and only removed from by the interrupt
+ *  handler, so no locking is needed.  If it is full, wait (up to the same
+ *  1s as I2CRB::wait) for a request to complete.
  ***************************************************************************/
 void I2CManagerClass::queueRequest(I2CRB *req) {
   req->status = I2C_STATUS_PENDING;
-  req->nextRequest = NULL;
+#if defined(DIAG_HALSTATS)
+  countRequest(req);
+#endif
 
-  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
-    if (!queueTail) 
-      queueHead = queueTail = req;  // Only item on queue
-    else
-      queueTail = queueTail->nextRequest = req; // Add to end
-    startTransaction();
+  unsigned long waitStart = millis();
+  while (queue.full() && (millis() - waitStart) <= 1000UL)
+    loop();
+  if (!queue.push(req)) {   // counted as a queue overflow
+    req->status = I2C_STATUS_TIMEOUT;
+    return;
   }
+  startTransaction();
+}
 
+/***************************************************************************
+ *  Report request queue usage (<D QUEUES>)
+ ***************************************************************************/
+void I2CManagerClass::printQueue(Print *stream) {
+  queue.print(stream, F("I2C"));
 }
 
 /***************************************************************************
@@ -137,13 +148,12 @@ uint8_t I2CManagerClass::read(uint8_t i2cAddress, uint8_t *readBuffer, uint8_t r
 void I2CManagerClass::checkForTimeout() {
   unsigned long currentMicros = micros();
   ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
-    I2CRB *t = queueHead;
-    if (state==I2C_STATE_ACTIVE && t!=0 && t==currentRequest && timeout > 0) {
+    I2CRB *t = currentRequest;
+    if (state==I2C_STATE_ACTIVE && t!=0 && timeout > 0) {
       // Check for timeout
       if (currentMicros - startTime > timeout) { 
-        // Excessive time. Dequeue request
-        queueHead = t->nextRequest;
-        if (!queueHead) queueTail = NULL;
+        // Excessive time. Dequeue request (safe here as interrupts are off)
+        queue.pop();
         currentRequest = NULL;
         // Post request as timed out.
         t->status = I2C_STATUS_TIMEOUT;
@@ -190,27 +200,26 @@ void I2CManagerClass::handleInterrupt() {
   if (state != I2C_STATE_ACTIVE && currentRequest != NULL) {
     // Remove completed request from head of queue
     ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
-      I2CRB * t = queueHead;
-      if (t == queueHead) {
-        queueHead = t->nextRequest;
-        if (!queueHead) queueTail = queueHead;
-        t->nBytes = rxCount;
-        t->status = state;
-        
-        // I2C state machine is now free for next request
-        currentRequest = NULL;
-        state = I2C_STATE_FREE;
+      I2CRB * t = currentRequest;
+      queue.pop();
+      t->nBytes = rxCount;
+      t->status = state;
+#if defined(DIAG_HALSTATS)
+      countCompletion(t);
+#endif
+      
+      // I2C state machine is now free for next request
+      currentRequest = NULL;
+      state = I2C_STATE_FREE;
 
-        // Start next request (if any)
-        I2CManager.startTransaction();
-      }
+      // Start next request (if any)
+      I2CManager.startTransaction();
     }
   }
 }
 
 // Fields in I2CManager class specific to Non-blocking implementation.
-I2CRB * volatile I2CManagerClass::queueHead = NULL;
-I2CRB * volatile I2CManagerClass::queueTail = NULL;
+SPSCRing<I2CRB *, I2C_QUEUE_SIZE> I2CManagerClass::queue;
 I2CRB * volatile I2CManagerClass::currentRequest = NULL;
 volatile uint8_t I2CManagerClass::state = I2C_STATE_FREE;
 volatile uint8_t I2CManagerClass::txCount;
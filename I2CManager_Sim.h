@@ -0,0 +1,125 @@
+/*
+ *  © 2026 agent. All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef I2CMANAGER_SIM_H
+#define I2CMANAGER_SIM_H
+
+#include <Arduino.h>
+#include "I2CManager.h"
+#include "I2CSimulator.h"
+
+/***************************************************************************
+ *  Initialise simulated I2C bus, with models of the devices that are 
+ *  created by default by IODevice::begin().
+ ***************************************************************************/
+void I2CManagerClass::_initialise() {
+  I2CSimulator::addMCP23017(0x20);
+  I2CSimulator::addMCP23017(0x21);
+  I2CSimulator::addPCA9685(0x40);
+  I2CSimulator::addPCA9685(0x41);
+}
+
+/***************************************************************************
+ *  Set I2C clock speed.  Not relevant to the simulated bus.
+ ***************************************************************************/
+void I2CManagerClass::_setClock(unsigned long i2cClockSpeed) {
+  (void)i2cClockSpeed;
+}
+
+/***************************************************************************
+ *  Write to a simulated I2C device (synchronous operation)
+ ***************************************************************************/
+uint8_t I2CManagerClass::write(uint8_t address, const uint8_t buffer[], uint8_t size, I2CRB *rb) {
+  rb->status = I2CSimulator::transfer(address, buffer, size, NULL, 0, NULL);
+#if defined(DIAG_HALSTATS)
+  rb->writeLen = size;
+  rb->readLen = 0;
+  countRequest(rb);
+  countCompletion(rb);
+#endif
+  return I2C_STATUS_OK;
+}
+
+/***************************************************************************
+ *  Write from PROGMEM (flash) to a simulated I2C device (synchronous operation)
+ ***************************************************************************/
+uint8_t I2CManagerClass::write_P(uint8_t address, const uint8_t buffer[], uint8_t size, I2CRB *rb) {
+  uint8_t ramBuffer[size];
+  const uint8_t *p1 = buffer;
+  for (uint8_t i=0; i<size; i++)
+    ramBuffer[i] = GETFLASH(p1++);
+  return write(address, ramBuffer, size, rb);
+}
+
+/***************************************************************************
+ *  Write (optional) followed by a read from a simulated I2C device 
+ *  (synchronous operation)
+ ***************************************************************************/
+uint8_t I2CManagerClass::read(uint8_t address, uint8_t readBuffer[], uint8_t readSize,
+                              const uint8_t writeBuffer[], uint8_t writeSize, I2CRB *rb)
+{
+  uint8_t nBytes;
+  rb->status = I2CSimulator::transfer(address, writeBuffer, writeSize, readBuffer, readSize, &nBytes);
+  rb->nBytes = nBytes;
+#if defined(DIAG_HALSTATS)
+  rb->writeLen = writeSize;
+  rb->readLen = readSize;
+  countRequest(rb);
+  countCompletion(rb);
+#endif
+  return I2C_STATUS_OK;
+}
+
+/***************************************************************************
+ *  Function to queue a request block and initiate operations.
+ * 
+ * As for the Wire version, this executes synchronously and the completion 
+ * status is in the request block.
+ ***************************************************************************/
+void I2CManagerClass::queueRequest(I2CRB *req) {
+  switch (req->operation) {
+    case OPERATION_READ:
+      read(req->i2cAddress, req->readBuffer, req->readLen, NULL, 0, req);
+      break;
+    case OPERATION_SEND:
+      write(req->i2cAddress, req->writeBuffer, req->writeLen, req);
+      break;
+    case OPERATION_SEND_P:
+      write_P(req->i2cAddress, req->writeBuffer, req->writeLen, req);
+      break;
+    case OPERATION_REQUEST:
+      read(req->i2cAddress, req->readBuffer, req->readLen, req->writeBuffer, req->writeLen, req);
+      break;
+  }
+}
+
+/***************************************************************************
+ *  Requests are executed synchronously so there is no queue to report.
+ ***************************************************************************/
+void I2CManagerClass::printQueue(Print *stream) { (void)stream; }
+
+/***************************************************************************
+ *  Loop function, for general background work
+ ***************************************************************************/
+void I2CManagerClass::loop() {}
+
+// Loop function
+void I2CManagerClass::checkForTimeout() {}
+
+#endif
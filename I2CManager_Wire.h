@@ -52,6 +52,12 @@ uint8_t I2CManagerClass::write(uint8_t address, const uint8_t buffer[], uint8_t
   Wire.beginTransmission(address);
   if (size > 0) Wire.write(buffer, size);
   rb->status = Wire.endTransmission();
+#if defined(DIAG_HALSTATS)
+  rb->writeLen = size;
+  rb->readLen = 0;
+  countRequest(rb);
+  countCompletion(rb);
+#endif
   return I2C_STATUS_OK;
 }
 
@@ -88,6 +94,12 @@ uint8_t I2CManagerClass::read(uint8_t address, uint8_t readBuffer[], uint8_t rea
   }
   rb->nBytes = nBytes;
   rb->status = status;
+#if defined(DIAG_HALSTATS)
+  rb->writeLen = writeSize;
+  rb->readLen = readSize;
+  countRequest(rb);
+  countCompletion(rb);
+#endif
   return I2C_STATUS_OK;
 }
 
@@ -116,6 +128,11 @@ void I2CManagerClass::queueRequest(I2CRB *req) {
   }
 }
 
+/***************************************************************************
+ *  Requests are executed synchronously so there is no queue to report.
+ ***************************************************************************/
+void I2CManagerClass::printQueue(Print *stream) { (void)stream; }
+
 /***************************************************************************
  *  Loop function, for general background work
  ***************************************************************************/
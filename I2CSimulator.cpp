@@ -0,0 +1,393 @@
+/*
+ *  © 2026 agent. All rights reserved.
+ *
+ *  This file is part of DCC++EX API
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "I2CSimulator.h"
+
+#if defined(I2C_USE_SIMULATION)
+
+#include "IODevice.h"
+#include "DIAG.h"
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// Device models
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * MCP23017 model, in the default configuration (IOCON.BANK=0, sequential operation),
+ * so that register pairs are adjacent and the register pointer increments after each
+ * byte.  Pins configured as inputs read the external state set by setInput(), and
+ * output pins read back the output latch.
+ */
+class SimMCP23017 : public I2CSimDevice {
+public:
+  SimMCP23017(uint8_t address) : I2CSimDevice(address) {
+    memset(_registers, 0, sizeof(_registers));
+    _registers[REG_IODIRA] = _registers[REG_IODIRB] = 0xff;  // All inputs after reset
+  }
+  uint8_t write(const uint8_t *buffer, uint8_t size) override {
+    if (size == 0) return I2C_STATUS_OK;  // Address probe
+    _pointer = buffer[0];
+    if (_pointer >= NUM_REGISTERS) return I2C_STATUS_TRANSMIT_ERROR;
+    for (uint8_t i=1; i<size; i++) {
+      // Writes to GPIO are directed to the output latch.
+      uint8_t reg = _pointer;
+      if (reg == REG_GPIOA || reg == REG_GPIOB) reg += REG_OLATA - REG_GPIOA;
+      _registers[reg] = buffer[i];
+      nextRegister();
+    }
+    return I2C_STATUS_OK;
+  }
+  uint8_t read(uint8_t *buffer, uint8_t size) override {
+    for (uint8_t i=0; i<size; i++) {
+      if (_pointer == REG_GPIOA || _pointer == REG_GPIOB) {
+        uint8_t port = _pointer - REG_GPIOA;
+        uint8_t inputs = _inputs >> (port * 8);
+        uint8_t iodir = _registers[REG_IODIRA + port];
+        buffer[i] = (inputs & iodir) | (_registers[REG_OLATA + port] & ~iodir);
+      } else
+        buffer[i] = _registers[_pointer];
+      nextRegister();
+    }
+    return I2C_STATUS_OK;
+  }
+  void setInput(uint8_t pin, bool state) override {
+    if (pin >= 16) return;
+    if (state)
+      _inputs |= (1 << pin);
+    else
+      _inputs &= ~(1 << pin);
+  }
+private:
+  void nextRegister() {
+    if (++_pointer >= NUM_REGISTERS) _pointer = 0;
+  }
+  enum : uint8_t {
+    REG_IODIRA = 0x00,
+    REG_IODIRB = 0x01,
+    REG_GPIOA = 0x12,
+    REG_GPIOB = 0x13,
+    REG_OLATA = 0x14,
+    REG_OLATB = 0x15,
+    NUM_REGISTERS = 0x16,
+  };
+  uint8_t _registers[NUM_REGISTERS];
+  uint8_t _pointer = 0;
+  uint16_t _inputs = 0xffff;  // External pin states, default high.
+};
+
+/*
+ * PCF8574 model.  The port has weak pull-ups, so a pin reads as 1 only if
+ * it has been written as 1 and is not pulled low externally.
+ */
+class SimPCF8574 : public I2CSimDevice {
+public:
+  SimPCF8574(uint8_t address) : I2CSimDevice(address) {}
+  uint8_t write(const uint8_t *buffer, uint8_t size) override {
+    if (size > 0) _latch = buffer[size-1];
+    return I2C_STATUS_OK;
+  }
+  uint8_t read(uint8_t *buffer, uint8_t size) override {
+    for (uint8_t i=0; i<size; i++)
+      buffer[i] = _latch & _inputs;
+    return I2C_STATUS_OK;
+  }
+  void setInput(uint8_t pin, bool state) override {
+    if (pin >= 8) return;
+    if (state)
+      _inputs |= (1 << pin);
+    else
+      _inputs &= ~(1 << pin);
+  }
+private:
+  uint8_t _latch = 0xff;
+  uint8_t _inputs = 0xff;
+};
+
+/*
+ * PCA9685 model.  MODE1, MODE2, the subaddress registers and the 16 sets of
+ * LED ON/OFF registers are modelled, plus the PRESCALE register.  The register
+ * pointer increments after each byte if MODE1.AI is set.
+ */
+class SimPCA9685 : public I2CSimDevice {
+public:
+  SimPCA9685(uint8_t address) : I2CSimDevice(address) {
+    memset(_registers, 0, sizeof(_registers));
+    _registers[REG_MODE1] = MODE1_SLEEP;
+    for (uint8_t channel=0; channel<16; channel++)
+      _registers[REG_LED0 + 4*channel + 3] = FULL_BIT;  // LEDn_OFF_H full off
+  }
+  uint8_t write(const uint8_t *buffer, uint8_t size) override {
+    if (size == 0) return I2C_STATUS_OK;  // Address probe
+    _pointer = buffer[0];
+    for (uint8_t i=1; i<size; i++) {
+      if (_pointer < NUM_REGISTERS)
+        _registers[_pointer] = buffer[i];
+      else if (_pointer == REG_PRESCALE)
+        _prescale = buffer[i];
+      if (_registers[REG_MODE1] & MODE1_AI) _pointer++;
+    }
+    return I2C_STATUS_OK;
+  }
+  uint8_t read(uint8_t *buffer, uint8_t size) override {
+    for (uint8_t i=0; i<size; i++) {
+      buffer[i] = _pointer < NUM_REGISTERS ? _registers[_pointer]
+        : _pointer == REG_PRESCALE ? _prescale : 0;
+      if (_registers[REG_MODE1] & MODE1_AI) _pointer++;
+    }
+    return I2C_STATUS_OK;
+  }
+  uint16_t getPWM(uint8_t channel) override {
+    if (channel >= 16) return 0;
+    uint8_t *led = &_registers[REG_LED0 + 4*channel];
+    if (led[3] & FULL_BIT) return 0;
+    if (led[1] & FULL_BIT) return 4095;
+    uint16_t on = ((led[1] & 0x0f) << 8) | led[0];
+    uint16_t off = ((led[3] & 0x0f) << 8) | led[2];
+    return (off - on) & 0x0fff;
+  }
+private:
+  enum : uint8_t {
+    REG_MODE1 = 0x00,
+    REG_LED0 = 0x06,
+    NUM_REGISTERS = 0x46,
+    REG_PRESCALE = 0xfe,
+    MODE1_SLEEP = 0x10,
+    MODE1_AI = 0x20,
+    FULL_BIT = 0x10,
+  };
+  uint8_t _registers[NUM_REGISTERS];
+  uint8_t _pointer = 0;
+  uint8_t _prescale = 0x1e;
+};
+
+/*
+ * ADS111x model.  The pointer register selects the conversion or config register.
+ * The conversion register returns the value set by setAnalogue() for the
+ * single-ended channel selected by the multiplexer bits in the config register.
+ */
+class SimADS111x : public I2CSimDevice {
+public:
+  SimADS111x(uint8_t address) : I2CSimDevice(address) {
+    memset(_values, 0, sizeof(_values));
+  }
+  uint8_t write(const uint8_t *buffer, uint8_t size) override {
+    if (size == 0) return I2C_STATUS_OK;  // Address probe
+    _pointer = buffer[0] & 0x03;
+    if (size >= 3) {
+      uint16_t value = ((uint16_t)buffer[1] << 8) | buffer[2];
+      if (_pointer == REG_CONFIG)
+        _config = value & ~CONFIG_OS;  // Conversion completes immediately
+      else if (_pointer != REG_CONVERSION)
+        _thresholds[_pointer - 2] = value;
+    }
+    return I2C_STATUS_OK;
+  }
+  uint8_t read(uint8_t *buffer, uint8_t size) override {
+    uint16_t value;
+    switch (_pointer) {
+      case REG_CONVERSION: {
+          // Multiplexer settings 4-7 select single-ended inputs AIN0-AIN3.
+          uint8_t mux = (_config >> 12) & 0x07;
+          value = (mux >= 4) ? _values[mux-4] : 0;
+        }
+        break;
+      case REG_CONFIG: value = _config | CONFIG_OS; break;
+      default: value = _thresholds[_pointer - 2]; break;
+    }
+    if (size > 0) buffer[0] = value >> 8;
+    if (size > 1) buffer[1] = value & 0xff;
+    return I2C_STATUS_OK;
+  }
+  void setAnalogue(uint8_t channel, int16_t value) override {
+    if (channel < 4) _values[channel] = value;
+  }
+private:
+  enum : uint8_t {
+    REG_CONVERSION = 0,
+    REG_CONFIG = 1,
+  };
+  static const uint16_t CONFIG_OS = 0x8000;
+  uint8_t _pointer = 0;
+  uint16_t _config = 0x8583;  // Power-on default
+  uint16_t _thresholds[2] = {0x8000, 0x7fff};
+  int16_t _values[4];
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// Benchmark device.  Drives the inputs of a set of simulated MCP23017 modules in turn,
+// and measures the time taken for each change to be notified through IONotifyCallback.
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class SimBenchmark : public IODevice {
+public:
+  SimBenchmark(VPIN firstVpin, uint8_t nModules, uint8_t firstAddress, unsigned long toggleInterval) {
+    _inputVpin = firstVpin;
+    _nModules = nModules;
+    _firstAddress = firstAddress;
+    _toggleInterval = toggleInterval;
+    _instance = this;
+    IONotifyCallback::add(notify);
+    addDevice(this);
+  }
+
+private:
+  void _loop(unsigned long currentMicros) override {
+    if (_pending) _missed++;
+    // Select next input pin, and change its state.  All pins are pulled low on
+    //  the first pass, and released on the second.
+    uint16_t nPins = _nModules * 16;
+    uint16_t pin = _step % nPins;
+    bool state = (_step / nPins) & 1;
+    if (++_step >= 2 * nPins) _step = 0;
+    _pendingVpin = _inputVpin + pin;
+    _pending = true;
+    _toggleTime = micros();
+    I2CSimulator::setInput(_firstAddress + pin/16, pin % 16, state);
+
+    // Report every 5 seconds.
+    if (currentMicros - _lastReport >= 5000000UL) {
+      if (_lastReport != 0)
+        DIAG(F("SimBench Toggles:%l Latency:%lus (%lus max) Missed:%l I2C transfers:%l"),
+          _toggles, _toggles ? _totalLatency / _toggles : 0, _maxLatency, _missed,
+          I2CSimulator::transferCount - _lastTransferCount);
+      _toggles = _totalLatency = _maxLatency = _missed = 0;
+      _lastTransferCount = I2CSimulator::transferCount;
+      _lastReport = currentMicros;
+    }
+    delayUntil(currentMicros + _toggleInterval);
+  }
+
+  static void notify(VPIN vpin, int value) {
+    (void)value;
+    SimBenchmark *bm = _instance;
+    if (bm->_pending && vpin == bm->_pendingVpin) {
+      unsigned long latency = micros() - bm->_toggleTime;
+      bm->_pending = false;
+      bm->_toggles++;
+      bm->_totalLatency += latency;
+      if (latency > bm->_maxLatency) bm->_maxLatency = latency;
+    }
+  }
+
+  void _display() override {
+    DIAG(F("SimBenchmark Vpins:%d-%d Interval:%lus"), _inputVpin,
+      _inputVpin + _nModules*16 - 1, _toggleInterval);
+  }
+
+  VPIN _inputVpin;
+  uint8_t _nModules;
+  uint8_t _firstAddress;
+  unsigned long _toggleInterval;
+  uint16_t _step = 0;
+  VPIN _pendingVpin = 0;
+  bool _pending = false;
+  unsigned long _toggleTime = 0;
+  unsigned long _lastReport = 0;
+  unsigned long _toggles = 0, _totalLatency = 0, _maxLatency = 0, _missed = 0;
+  unsigned long _lastTransferCount = 0;
+  static SimBenchmark *_instance;
+};
+
+SimBenchmark *SimBenchmark::_instance = NULL;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// I2CSimulator static functions
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void I2CSimulator::addMCP23017(uint8_t address) {
+  if (!findDevice(address)) addDevice(new SimMCP23017(address));
+}
+
+void I2CSimulator::addPCF8574(uint8_t address) {
+  if (!findDevice(address)) addDevice(new SimPCF8574(address));
+}
+
+void I2CSimulator::addPCA9685(uint8_t address) {
+  if (!findDevice(address)) addDevice(new SimPCA9685(address));
+}
+
+void I2CSimulator::addADS111x(uint8_t address) {
+  if (!findDevice(address)) addDevice(new SimADS111x(address));
+}
+
+void I2CSimulator::setInput(uint8_t address, uint8_t pin, bool state) {
+  I2CSimDevice *device = findDevice(address);
+  if (device) device->setInput(pin, state);
+}
+
+void I2CSimulator::setAnalogue(uint8_t address, uint8_t channel, int16_t value) {
+  I2CSimDevice *device = findDevice(address);
+  if (device) device->setAnalogue(channel, value);
+}
+
+uint16_t I2CSimulator::getPWM(uint8_t address, uint8_t channel) {
+  I2CSimDevice *device = findDevice(address);
+  return device ? device->getPWM(channel) : 0;
+}
+
+// Execute a transaction on the simulated bus.  A device which doesn't exist doesn't
+// acknowledge its address, as on a real bus.
+uint8_t I2CSimulator::transfer(uint8_t address, const uint8_t *writeBuffer, uint8_t writeSize,
+    uint8_t *readBuffer, uint8_t readSize, uint8_t *bytesRead) {
+  if (bytesRead) *bytesRead = 0;
+  I2CSimDevice *device = findDevice(address);
+  if (!device) return I2C_STATUS_NEGATIVE_ACKNOWLEDGE;
+  uint8_t status = I2C_STATUS_OK;
+  if (writeSize > 0 || readSize == 0)
+    status = device->write(writeBuffer, writeSize);
+  if (status == I2C_STATUS_OK && readSize > 0) {
+    status = device->read(readBuffer, readSize);
+    if (status == I2C_STATUS_OK && bytesRead) *bytesRead = readSize;
+  }
+  transferCount++;
+  byteCount += writeSize + readSize;
+  return status;
+}
+
+void I2CSimulator::createBenchmark(VPIN firstVpin, uint8_t nModules, uint8_t firstAddress,
+    unsigned long toggleInterval) {
+  // The simulated bus doesn't restrict the address range of each device type, so
+  //  any number of modules may be created, as long as the addresses are free.
+  for (uint8_t module=0; module<nModules; module++) {
+    uint8_t address = firstAddress + module;
+    VPIN vpin = firstVpin + module*16;
+    addMCP23017(address);
+    MCP23017::create(vpin, 16, address);
+    for (uint8_t pin=0; pin<16; pin++)
+      IODevice::configureInput(vpin+pin, true);
+  }
+  new SimBenchmark(firstVpin, nModules, firstAddress, toggleInterval);
+}
+
+I2CSimDevice *I2CSimulator::findDevice(uint8_t address) {
+  for (I2CSimDevice *device = _firstDevice; device; device = device->_next)
+    if (device->_address == address) return device;
+  return NULL;
+}
+
+void I2CSimulator::addDevice(I2CSimDevice *device) {
+  device->_next = _firstDevice;
+  _firstDevice = device;
+}
+
+I2CSimDevice *I2CSimulator::_firstDevice = NULL;
+unsigned long I2CSimulator::transferCount = 0;
+unsigned long I2CSimulator::byteCount = 0;
+
+#endif // I2C_USE_SIMULATION
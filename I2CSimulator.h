@@ -0,0 +1,111 @@
+/*
+ *  © 2026 agent. All rights reserved.
+ *
+ *  This file is part of DCC++EX API
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Simulated I2C bus, for exercising the HAL device drivers without any I2C modules
+ * connected.  It is enabled by defining I2C_USE_SIMULATION in I2CManager.h, in which
+ * case all I2CManager requests are executed synchronously (as for the Wire
+ * implementation) against register-level models of the following devices:
+ *
+ *   MCP23017 16-bit GPIO extender (IODIR, GPPU, GPIO and OLAT registers)
+ *   PCF8574 8-bit GPIO extender (quasi-bidirectional port)
+ *   PCA9685 16-channel PWM controller (LED registers, auto-increment)
+ *   ADS111x ADC (config and conversion registers, single-ended channels)
+ *
+ * Models for the devices created by IODevice::begin() (MCP23017 at 0x20 and 0x21,
+ * PCA9685 at 0x40 and 0x41) are created automatically.  Others should be created
+ * in halSetup() before the corresponding HAL device, e.g.
+ *   I2CSimulator::addPCF8574(0x38);
+ *   PCF8574::create(300, 8, 0x38);
+ *
+ * Inputs of the models may be driven with setInput() and setAnalogue(), and the PWM
+ * outputs inspected with getPWM().
+ *
+ * For measuring HAL performance, I2CSimulator::createBenchmark() creates a number of
+ * simulated MCP23017 modules and an IODevice which toggles their inputs in turn.
+ * It measures the time from each input change to the IONotifyCallback invocation,
+ * and reports on the diagnostic output every 5 seconds.  test/host/hal_benchmark
+ * runs it on a Linux host, on virtual time.
+ */
+
+#ifndef I2CSIMULATOR_H
+#define I2CSIMULATOR_H
+
+#include "I2CManager.h"
+
+#if defined(I2C_USE_SIMULATION)
+
+#include "IODevice.h"
+
+// Base class for the device models.
+class I2CSimDevice {
+public:
+  I2CSimDevice(uint8_t address) { _address = address; }
+  // Write bytes received from the bus to the device.
+  virtual uint8_t write(const uint8_t *buffer, uint8_t size) = 0;
+  // Read bytes from the device onto the bus.
+  virtual uint8_t read(uint8_t *buffer, uint8_t size) = 0;
+  // Functions for driving inputs and checking outputs, where supported.
+  virtual void setInput(uint8_t pin, bool state) { (void)pin; (void)state; }
+  virtual void setAnalogue(uint8_t channel, int16_t value) { (void)channel; (void)value; }
+  virtual uint16_t getPWM(uint8_t channel) { (void)channel; return 0; }
+
+  uint8_t _address;
+  I2CSimDevice *_next = 0;
+};
+
+class I2CSimulator {
+public:
+  // Functions for creating device models on the simulated bus.
+  static void addMCP23017(uint8_t address);
+  static void addPCF8574(uint8_t address);
+  static void addPCA9685(uint8_t address);
+  static void addADS111x(uint8_t address);
+
+  // Set the external state of a GPIO input pin (true=high, false=pulled low).
+  static void setInput(uint8_t address, uint8_t pin, bool state);
+  // Set the value returned by an ADC channel.
+  static void setAnalogue(uint8_t address, uint8_t channel, int16_t value);
+  // Get the PWM value (0-4095) of a PCA9685 channel.
+  static uint16_t getPWM(uint8_t address, uint8_t channel);
+
+  // Execute an I2C transaction: an optional write, followed by an optional read.
+  // Returns an I2C_STATUS_xxx code.
+  static uint8_t transfer(uint8_t address, const uint8_t *writeBuffer, uint8_t writeSize,
+    uint8_t *readBuffer, uint8_t readSize, uint8_t *bytesRead);
+
+  // Create nModules MCP23017 modules (from firstAddress and firstVpin upwards) with
+  //  all pins configured as inputs, and a benchmark device to exercise them.
+  static void createBenchmark(VPIN firstVpin, uint8_t nModules, uint8_t firstAddress=0x20,
+    unsigned long toggleInterval=10000UL);
+
+  // Count of completed transfers, and of the data bytes in them (not counting
+  //  the address bytes), for working out the time they would take on a real bus.
+  static unsigned long transferCount;
+  static unsigned long byteCount;
+
+private:
+  static I2CSimDevice *findDevice(uint8_t address);
+  static void addDevice(I2CSimDevice *device);
+  static I2CSimDevice *_firstDevice;
+};
+
+#endif // I2C_USE_SIMULATION
+
+#endif // I2CSIMULATOR_H
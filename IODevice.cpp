@@ -30,6 +30,16 @@
 #define USE_FAST_IO
 #endif
 
+// When DIAG_HALSTATS is defined, I2C traffic during a call to a device is counted
+// against that device, and calls to its read and write functions are counted.
+#if defined(DIAG_HALSTATS)
+#define HALSTATS_SCOPE(dev) I2CStatsScope statsScope(dev)
+#define HALSTATS_COUNT(counter) counter++
+#else
+#define HALSTATS_SCOPE(dev)
+#define HALSTATS_COUNT(counter)
+#endif
+
 // Link to halSetup function.  If not defined, the function reference will be NULL.
 extern __attribute__((weak)) void halSetup();
 extern __attribute__((weak)) void mySetup();  // Deprecated function name, output warning if it's declared
@@ -60,6 +70,7 @@ void IODevice::begin() {
 
   // Call the begin() methods of each configured device in turn
   for (IODevice *dev=_firstDevice; dev!=NULL; dev = dev->_nextDevice) {
+    HALSTATS_SCOPE(dev);
     dev->_begin();
   }
   _initPhase = false;
@@ -75,35 +86,70 @@ void IODevice::begin() {
     halSetup();
 }
 
-// Overarching static loop() method for the IODevice subsystem.  Works through the
-// list of installed devices and calls their individual _loop() method.
+// Overarching static loop() method for the IODevice subsystem.  Calls the _loop() method
+// of the device at the top of the loop schedule, if it is due.
 // Devices may or may not implement this, but if they do it is useful for things like animations 
-// or flashing LEDs.
+// or flashing LEDs.  Devices which don't implement _loop() are removed from the schedule 
+// after the first call, so don't cost anything thereafter.
+// If IO_LOOP_BUDGET_MICROS is defined, then all devices that were due on entry are 
+// serviced once each, in order of due time, until the time budget has been used.
 // The current value of micros() is passed as a parameter, so the called loop function
 // doesn't need to invoke it.
 void IODevice::loop() {
-  unsigned long currentMicros = micros();
-  
-  IODevice *lastLoopDevice = _nextLoopDevice;  // So we know when to stop...
-  // Loop through devices until we find one ready to be serviced.
-  do {
-    if (!_nextLoopDevice) _nextLoopDevice = _firstDevice;
-    if (_nextLoopDevice) {
-      if (_nextLoopDevice->_deviceState != DEVSTATE_FAILED 
-            && ((long)(currentMicros - _nextLoopDevice->_nextEntryTime)) >= 0) {
-        // Found one ready to run, so invoke its _loop method.
-        _nextLoopDevice->_nextEntryTime = currentMicros;
-        _nextLoopDevice->_loop(currentMicros);
-        _nextLoopDevice = _nextLoopDevice->_nextDevice;
-        break;
-      }
-      // Not this one, move to next one
-      _nextLoopDevice = _nextLoopDevice->_nextDevice;
+  unsigned long startMicros = micros();
+  unsigned long currentMicros = startMicros;
+
+  while (_loopHeapSize > 0) {
+    IODevice *dev = _loopHeap[0];
+    // Stop when the first device in the schedule isn't yet due.
+    if ((long)(startMicros - dev->_nextEntryTime) < 0) break;
+    if (dev->_deviceState == DEVSTATE_FAILED) {
+      // Failed devices don't get any more _loop() calls.
+      _unschedule(dev);
+      continue;
+    }
+    // Found one ready to run, so invoke its _loop method.  The device's position
+    //  in the schedule is updated by any call to delayUntil(), and again afterwards
+    //  to allow for the new entry time.
+    dev->_nextEntryTime = currentMicros;
+    {
+      HALSTATS_SCOPE(dev);
+      dev->_loop(currentMicros);
     }
-  } while (_nextLoopDevice != lastLoopDevice); // Stop looking when we've done all.
+#if defined(IO_LOOP_BUDGET_MICROS)
+    // A device that hasn't rescheduled itself into the future is due again
+    //  straight away, but not in this pass, even if micros() hasn't moved on.
+    if ((long)(dev->_nextEntryTime - startMicros) <= 0) dev->_nextEntryTime = startMicros + 1;
+#endif
+    if (dev->_heapIndex != NOT_SCHEDULED) _siftDown(dev->_heapIndex);
+
+#if defined(DIAG_LOOPTIMES) || defined(DIAG_HALSTATS) || defined(IO_LOOP_BUDGET_MICROS)
+    unsigned long endMicros = micros();
+#endif
+#if defined(DIAG_LOOPTIMES) || defined(DIAG_HALSTATS)
+    unsigned long deviceElapsed = endMicros - currentMicros;
+#endif
+#if defined(DIAG_LOOPTIMES)
+    dev->_loopCalls++;
+    dev->_loopMicros += deviceElapsed;
+    if (deviceElapsed > dev->_maxLoopMicros) dev->_maxLoopMicros = deviceElapsed;
+#endif
+#if defined(DIAG_HALSTATS)
+    dev->_statsLoopCalls++;
+    dev->_statsLoopMicros += deviceElapsed;
+    if (deviceElapsed > dev->_statsMaxLoopMicros) dev->_statsMaxLoopMicros = deviceElapsed;
+#endif
+#if defined(IO_LOOP_BUDGET_MICROS)
+    if (endMicros - startMicros >= IO_LOOP_BUDGET_MICROS) break;
+    currentMicros = endMicros;
+#else
+    break;  // Only one device per call
+#endif
+  }
   
   // Report loop time if diags enabled
 #if defined(DIAG_LOOPTIMES)
+  currentMicros = startMicros;
   static unsigned long lastMicros = 0;
   // Measure time since loop() method started.
   unsigned long halElapsed = micros() - currentMicros;
@@ -124,9 +170,19 @@ void IODevice::loop() {
     count++;
   }
   if (currentMicros - lastOutputTime > interval) {
-    if (lastOutputTime > 0) 
+    if (lastOutputTime > 0) {
       DIAG(F("Loop Total:%lus (%lus max) HAL:%lus (%lus max)"), 
         total/count, maxElapsed, halTotal/count, maxHalElapsed);
+      // Report service time of each device that has been called.
+      for (IODevice *dev = _firstDevice; dev != 0; dev = dev->_nextDevice) {
+        if (dev->_loopCalls > 0)
+          DIAG(F("HAL Vpins:%d-%d Calls:%l Avg:%lus Max:%lus"), (int)dev->_firstVpin, 
+            (int)dev->_firstVpin+dev->_nPins-1, dev->_loopCalls, 
+            dev->_loopMicros/dev->_loopCalls, dev->_maxLoopMicros);
+      }
+    }
+    for (IODevice *dev = _firstDevice; dev != 0; dev = dev->_nextDevice)
+      dev->_loopCalls = dev->_loopMicros = dev->_maxLoopMicros = 0;
     maxElapsed = maxHalElapsed = total = halTotal = count = 0;
     lastOutputTime = currentMicros;
   }
@@ -141,6 +197,23 @@ void IODevice::DumpAll() {
   }
 }
 
+// Display the statistics of each device on the diagnostic stream, and reset them.
+void IODevice::DumpStats() {
+#if defined(DIAG_HALSTATS)
+  for (IODevice *dev = _firstDevice; dev != 0; dev = dev->_nextDevice) {
+    dev->_display();
+    DIAG(F("  Loop:%l calls %lus (%lus max) Read:%l Write:%l I2C:%l bytes %d errors"),
+      dev->_statsLoopCalls, dev->_statsLoopMicros, dev->_statsMaxLoopMicros, dev->_readCount, dev->_writeCount,
+      dev->_i2cStats.bytes, dev->_i2cStats.errors);
+    dev->_statsLoopCalls = dev->_statsLoopMicros = dev->_statsMaxLoopMicros = 0;
+    dev->_readCount = dev->_writeCount = 0;
+    dev->_i2cStats.bytes = dev->_i2cStats.errors = 0;
+  }
+#else
+  DIAG(F("HAL statistics not enabled (DIAG_HALSTATS)"));
+#endif
+}
+
 // Determine if the specified vpin is allocated to a device.
 bool IODevice::exists(VPIN vpin) {
   return findDevice(vpin) != NULL;
@@ -163,7 +236,10 @@ void IODevice::_display() {
 //   Return false if not found.
 bool IODevice::configure(VPIN vpin, ConfigTypeEnum configType, int paramCount, int params[]) {
   IODevice *dev = findDevice(vpin);
-  if (dev) return dev->_configure(vpin, configType, paramCount, params);
+  if (dev) {
+    HALSTATS_SCOPE(dev);
+    return dev->_configure(vpin, configType, paramCount, params);
+  }
 #ifdef DIAG_IO
   DIAG(F("IODevice::configure(): Vpin ID %d not found!"), (int)vpin);
 #endif
@@ -173,8 +249,11 @@ bool IODevice::configure(VPIN vpin, ConfigTypeEnum configType, int paramCount, i
 // Read value from virtual pin.
 int IODevice::read(VPIN vpin) {
   for (IODevice *dev = _firstDevice; dev != 0; dev = dev->_nextDevice) {
-    if (dev->owns(vpin)) 
+    if (dev->owns(vpin)) {
+      HALSTATS_SCOPE(dev);
+      HALSTATS_COUNT(dev->_readCount);
       return dev->_read(vpin);
+    }
   }
 #ifdef DIAG_IO
   DIAG(F("IODevice::read(): Vpin %d not found!"), (int)vpin);
@@ -185,8 +264,11 @@ int IODevice::read(VPIN vpin) {
 // Read analogue value from virtual pin.
 int IODevice::readAnalogue(VPIN vpin) {
   for (IODevice *dev = _firstDevice; dev != 0; dev = dev->_nextDevice) {
-    if (dev->owns(vpin)) 
+    if (dev->owns(vpin)) {
+      HALSTATS_SCOPE(dev);
+      HALSTATS_COUNT(dev->_readCount);
       return dev->_readAnalogue(vpin);
+    }
   }
 #ifdef DIAG_IO
   DIAG(F("IODevice::readAnalogue(): Vpin %d not found!"), (int)vpin);
@@ -199,6 +281,8 @@ int IODevice::readAnalogue(VPIN vpin) {
 void IODevice::write(VPIN vpin, int value) {
   IODevice *dev = findDevice(vpin);
   if (dev) {
+    HALSTATS_SCOPE(dev);
+    HALSTATS_COUNT(dev->_writeCount);
     dev->_write(vpin, value);
     return;
   }
@@ -218,6 +302,8 @@ void IODevice::write(VPIN vpin, int value) {
 void IODevice::writeAnalogue(VPIN vpin, int value, uint8_t param1, uint16_t param2) {
   IODevice *dev = findDevice(vpin);
   if (dev) {
+    HALSTATS_SCOPE(dev);
+    HALSTATS_COUNT(dev->_writeCount);
     dev->_writeAnalogue(vpin, value, param1, param2);
     return;
   }
@@ -231,9 +317,11 @@ void IODevice::writeAnalogue(VPIN vpin, int value, uint8_t param1, uint16_t para
 //  an animation or fade over a period of time.
 bool IODevice::isBusy(VPIN vpin) {
   IODevice *dev = findDevice(vpin);
-  if (dev) 
+  if (dev) {
+    HALSTATS_SCOPE(dev);
+    HALSTATS_COUNT(dev->_readCount);
     return dev->_read(vpin);
-  else
+  } else
     return false;
 }
 
@@ -258,10 +346,15 @@ void IODevice::addDevice(IODevice *newDevice) {
   }
   newDevice->_nextDevice = 0;
 
+  // Schedule first _loop() call for the device.
+  newDevice->delayUntil(micros());
+
   // If the IODevice::begin() method has already been called, initialise device here.  If not,
   // the device's _begin() method will be called by IODevice::begin().
-  if (!_initPhase)
+  if (!_initPhase) {
+    HALSTATS_SCOPE(newDevice);
     newDevice->_begin();
+  }
 }
 
 // Private helper function to locate a device by VPIN.  Returns NULL if not found.
@@ -274,6 +367,72 @@ IODevice *IODevice::findDevice(VPIN vpin) {
   }
   return NULL;
 }
+
+// Private helper function to add a device to the loop schedule, or to reposition it
+//  if its _nextEntryTime has been changed.
+void IODevice::_schedule(IODevice *dev) {
+  if (dev->_heapIndex == NOT_SCHEDULED) {
+    if (_loopHeapSize == _loopHeapCapacity) {
+      // Extend the heap, a few entries at a time.
+      if (_loopHeapCapacity >= NOT_SCHEDULED-4) return;
+      IODevice **newHeap = (IODevice **)realloc(_loopHeap, (_loopHeapCapacity+4) * sizeof(IODevice *));
+      if (!newHeap) return;  // Out of memory; device won't get _loop() calls.
+      _loopHeap = newHeap;
+      _loopHeapCapacity += 4;
+    }
+    dev->_heapIndex = _loopHeapSize;
+    _loopHeap[_loopHeapSize++] = dev;
+  }
+  _siftUp(dev->_heapIndex);
+  _siftDown(dev->_heapIndex);
+}
+
+// Private helper function to remove a device from the loop schedule.
+void IODevice::_unschedule(IODevice *dev) {
+  uint8_t index = dev->_heapIndex;
+  if (index == NOT_SCHEDULED) return;
+  dev->_heapIndex = NOT_SCHEDULED;
+  IODevice *last = _loopHeap[--_loopHeapSize];
+  if (index < _loopHeapSize) {
+    // Move last entry into the vacated slot, then restore the heap order.
+    _loopHeap[index] = last;
+    last->_heapIndex = index;
+    _siftUp(index);
+    _siftDown(last->_heapIndex);
+  }
+}
+
+// Heap helper functions.  Times are compared as a signed difference, to allow
+//  for wraparound of the micros() value.
+void IODevice::_siftUp(uint8_t index) {
+  while (index > 0) {
+    uint8_t parent = (index - 1) / 2;
+    if ((long)(_loopHeap[index]->_nextEntryTime - _loopHeap[parent]->_nextEntryTime) >= 0) break;
+    _swap(index, parent);
+    index = parent;
+  }
+}
+
+void IODevice::_siftDown(uint8_t index) {
+  for (;;) {
+    uint16_t child = 2 * index + 1;
+    if (child >= _loopHeapSize) break;
+    if (child + 1 < _loopHeapSize 
+        && (long)(_loopHeap[child+1]->_nextEntryTime - _loopHeap[child]->_nextEntryTime) < 0)
+      child++;
+    if ((long)(_loopHeap[child]->_nextEntryTime - _loopHeap[index]->_nextEntryTime) >= 0) break;
+    _swap(index, child);
+    index = child;
+  }
+}
+
+void IODevice::_swap(uint8_t index1, uint8_t index2) {
+  IODevice *dev = _loopHeap[index1];
+  _loopHeap[index1] = _loopHeap[index2];
+  _loopHeap[index2] = dev;
+  _loopHeap[index1]->_heapIndex = index1;
+  dev->_heapIndex = index2;
+}
   
 //==================================================================================================================
 // Static data
@@ -285,8 +444,10 @@ IONotifyCallback *IONotifyCallback::first = 0;
 // Start of chain of devices.
 IODevice *IODevice::_firstDevice = 0;
 
-// Reference to next device to be called on _loop() method.
-IODevice *IODevice::_nextLoopDevice = 0;
+// Schedule of devices to be called on _loop() method.
+IODevice **IODevice::_loopHeap = 0;
+uint8_t IODevice::_loopHeapSize = 0;
+uint8_t IODevice::_loopHeapCapacity = 0;
 
 // Flag which is reset when IODevice::begin has been called.
 bool IODevice::_initPhase = true;  
@@ -338,6 +499,9 @@ void IODevice::loop() {}
 void IODevice::DumpAll() {
   DIAG(F("NO HAL CONFIGURED!"));
 }
+void IODevice::DumpStats() {
+  DIAG(F("NO HAL CONFIGURED!"));
+}
 bool IODevice::exists(VPIN vpin) { return (vpin > 2 && vpin < NUM_DIGITAL_PINS); }
 void IODevice::setGPIOInterruptPin(int16_t) {}
 
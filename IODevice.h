@@ -26,6 +26,15 @@
 // Define symbol DIAG_LOOPTIMES to enable CS loop execution time to be reported
 //#define DIAG_LOOPTIMES
 
+// Define symbol DIAG_HALSTATS to count calls, execution time and I2C traffic for each
+// HAL device, for display with the <D HAL STATS> command.  It must be defined in the
+// build flags (see I2CManager.h).
+
+// Define symbol IO_LOOP_BUDGET_MICROS to allow IODevice::loop() to service all devices that 
+// are due, until the specified time (in microseconds) has been used up.  By default, only
+// one device is serviced on each call.
+//#define IO_LOOP_BUDGET_MICROS 500
+
 // Define symbol IO_NO_HAL to reduce FLASH footprint when HAL features not required
 // The HAL is disabled by default on Nano and Uno platforms, because of limited flash space.
 #if defined(ARDUINO_AVR_NANO) || defined(ARDUINO_AVR_UNO) 
@@ -39,11 +48,23 @@
 // It is recommended to enable this, unless it causes you problems.
 #define IO_SWITCH_OFF_SERVO
 
+// Define symbol IO_SERVO_REFRESH_MS to set the interval (in milliseconds) between
+// updates of PCA9685 servo animations.  The default of 50ms suits most servos; it
+// may be reduced down to 20ms (the PWM pulse period) for smoother movement.
+//#define IO_SERVO_REFRESH_MS 20
+#ifndef IO_SERVO_REFRESH_MS
+#define IO_SERVO_REFRESH_MS 50
+#elif IO_SERVO_REFRESH_MS < 20
+#error IO_SERVO_REFRESH_MS must not be less than 20ms
+#endif
+
 #include "DIAG.h"
 #include "FSH.h"
 #include "I2CManager.h"
 #include "inttypes.h"
 
+class ObjectPool;
+
 typedef uint16_t VPIN;
 // Limit VPIN number to max 32767.  Above this number, printing often gives negative values.
 // This should be enough for 99% of users.
@@ -93,6 +114,7 @@ public:
     CONFIGURE_INPUT = 1,
     CONFIGURE_SERVO = 2,
     CONFIGURE_OUTPUT = 3,
+    CONFIGURE_ANALOGINPUT = 4,
   } ConfigTypeEnum;
 
   typedef enum : uint8_t {
@@ -125,6 +147,13 @@ public:
     return IODevice::configure(vpin, CONFIGURE_SERVO, 5, params);
   }
 
+  // User-friendly function for configuring thresholds on an analogue input pin.  The pin's
+  //  digital state becomes 1 at or above highThreshold, and 0 below lowThreshold.
+  inline static bool configureAnalogIn(VPIN vpin, int lowThreshold, int highThreshold) {
+    int params[] = {lowThreshold, highThreshold};
+    return IODevice::configure(vpin, CONFIGURE_ANALOGINPUT, 2, params);
+  }
+
   // write invokes the IODevice instance's _write method.
   static void write(VPIN vpin, int value);
 
@@ -149,6 +178,9 @@ public:
 
   static void DumpAll();
 
+  // Display statistics for each device, accumulated since the previous call.
+  static void DumpStats();
+
   // exists checks whether there is a device owning the specified vpin
   static bool exists(VPIN vpin);
 
@@ -203,7 +235,8 @@ protected:
 
   // Method to perform updates on an ongoing basis (optionally implemented within device class)
   virtual void _loop(unsigned long currentMicros) {
-    delayUntil(currentMicros + 0x7fffffff); // Largest time in the future!  Effectively disable _loop calls.
+    (void)currentMicros;
+    _unschedule(this);  // Not required, so remove device from the loop schedule.
   };
 
   // Method for displaying info on DIAG output (optionally implemented within device class)
@@ -212,9 +245,10 @@ protected:
   // Destructor
   virtual ~IODevice() {};
 
-  // Non-virtual function
+  // Non-virtual function.  Sets the time of the next _loop() call, and (re)schedules the device.
   void delayUntil(unsigned long futureMicrosCount) {
     _nextEntryTime = futureMicrosCount;
+    _schedule(this);
   }
   
   // Common object fields.
@@ -244,7 +278,46 @@ private:
   unsigned long _nextEntryTime;
   static IODevice *_firstDevice;
 
-  static IODevice *_nextLoopDevice;
+  // Devices requiring _loop() calls are held in a binary heap, ordered by
+  //  _nextEntryTime, so that the next device due is always at the top.
+  static const uint8_t NOT_SCHEDULED = 255;
+  uint8_t _heapIndex = NOT_SCHEDULED; // Position in _loopHeap
+  static IODevice **_loopHeap;
+  static uint8_t _loopHeapSize;
+  static uint8_t _loopHeapCapacity;
+  static void _schedule(IODevice *dev);
+  static void _unschedule(IODevice *dev);
+  static void _siftUp(uint8_t index);
+  static void _siftDown(uint8_t index);
+  static void _swap(uint8_t index1, uint8_t index2);
+
+#if defined(DIAG_LOOPTIMES)
+  // Per-device _loop() statistics, reset by each DIAG_LOOPTIMES report
+  unsigned long _loopCalls = 0;
+  unsigned long _loopMicros = 0;
+  unsigned long _maxLoopMicros = 0;
+#endif
+#if defined(DIAG_HALSTATS)
+  // Per-device _loop(), read/write and I2C statistics, reset by <D HAL STATS>
+  unsigned long _statsLoopCalls = 0;
+  unsigned long _statsLoopMicros = 0;
+  unsigned long _statsMaxLoopMicros = 0;
+  unsigned long _readCount = 0;
+  unsigned long _writeCount = 0;
+  I2CStats _i2cStats = {0, 0};
+
+  // Helper which attributes I2C traffic to a device for the lifetime of the object.
+  class I2CStatsScope {
+  public:
+    I2CStatsScope(IODevice *dev) : _savedContext(I2CManager.statsContext) {
+      I2CManager.statsContext = &dev->_i2cStats;
+    }
+    ~I2CStatsScope() { I2CManager.statsContext = _savedContext; }
+  private:
+    I2CStats *_savedContext;
+  };
+#endif
+
   static bool _initPhase;
 };
 
@@ -266,6 +339,9 @@ public:
     Medium = 2,   // 1 second end-to-end
     Slow = 3,     // 2 seconds end-to-end
     Bounce = 4,   // For semaphores/turnouts with a bit of bounce!!
+    EaseIn = 0x10,    // Flags to be ORed in with Fast/Medium/Slow/UseDuration
+    EaseOut = 0x20,   //  to shape the movement, e.g. Medium|EaseInOut starts
+    EaseInOut = 0x30, //  slowly, speeds up, and then slows down at the end.
     NoPowerOff = 0x80, // Flag to be ORed in to suppress power off after move.
   };
 
@@ -278,8 +354,8 @@ private:
   void _writeAnalogue(VPIN vpin, int value, uint8_t profile, uint16_t duration) override;
   int _read(VPIN vpin) override; // returns the digital state or busy status of the device
   void _loop(unsigned long currentMicros) override;
-  void updatePosition(uint8_t pin);
-  void writeDevice(uint8_t pin, int value);
+  bool updatePosition(uint8_t pin);
+  void writeDevice(uint8_t firstPin, uint8_t lastPin);
   void _display() override;
 
   uint8_t _I2CAddress; // 0x40-0x43 possible
@@ -290,23 +366,37 @@ private:
     uint16_t currentPosition : 12;
     uint16_t fromPosition : 12;
     uint16_t toPosition : 12; 
+    uint16_t outputOff : 1; // Set when PWM has been switched off after a move.
     uint8_t profile;  // Config parameter
     uint16_t stepNumber; // Index of current step (starting from 0)
     uint16_t numSteps;  // Number of steps in animation, or 0 if none in progress.
+    uint16_t stepIncrement; // Fraction (1/65536ths) of the animation covered by each step.
     uint8_t currentProfile; // profile being used for current animation.
     uint16_t duration; // time (tenths of a second) for animation to complete.
-  }; // 14 bytes per element, i.e. per pin in use
+  }; // 16 bytes per element, i.e. per pin in use
   
   struct ServoData *_servoData [16];
+  static ObjectPool _servoDataPool;  // shared by all PCA9685 devices
+
+  static uint16_t interpolate(struct ServoData *s);
 
-  static const uint8_t _catchupSteps = 5; // number of steps to wait before switching servo off
-  static const byte FLASH _bounceProfile[30];
+  // Easing curves, in units of 1/4096 of the movement, held in flash.  Each
+  //  curve is interpolated linearly between entries.  The tables are generated at
+  //  compile time by the CURVE macro in IO_PCA9685.cpp, which assumes 16 segments.
+  static const uint8_t _curveSegments = 16;
+  static const uint16_t FLASH _easeInCurve[_curveSegments+1];
+  static const uint16_t FLASH _easeOutCurve[_curveSegments+1];
+  static const uint16_t FLASH _easeInOutCurve[_curveSegments+1];
+  static const uint16_t FLASH _bounceProfile[30];
+  static const uint16_t _bounceDuration = 1450; // milliseconds
 
-  const unsigned int refreshInterval = 50; // refresh every 50ms
+  static const unsigned int refreshInterval = IO_SERVO_REFRESH_MS; // refresh interval in ms
+  static const uint8_t _catchupSteps = 250 / refreshInterval; // steps to wait (~250ms) before switching servo off
 
-  // structures for setting up non-blocking writes to servo controller
+  // structures for setting up non-blocking writes to servo controller.  All 
+  //  changed outputs are written in a single auto-increment transfer.
   I2CRB requestBlock;
-  uint8_t outputBuffer[5];
+  uint8_t *_outputBuffer = NULL; // Register address plus 4 bytes per pin
 };
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
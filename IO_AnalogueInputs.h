@@ -29,52 +29,100 @@
 #include "DIAG.h"
 #include "FSH.h"
 
+// Number of samples held for each channel when filtering is enabled.  The filtered value
+// is the average or median of the most recent IO_ANALOGUE_SAMPLES samples.
+#ifndef IO_ANALOGUE_SAMPLES
+#define IO_ANALOGUE_SAMPLES 5
+#endif
+
 /**********************************************************************************************
  * ADS111x class for I2C-connected analogue input modules ADS1113, ADS1114 and ADS1115.
  * 
  * ADS1113 and ADS1114 are restricted to 1 input.  ADS1115 has a multiplexer which allows 
  * any of four input pins to be read by its ADC.
  * 
- * The driver polls the device in accordance with the constant 'scanInterval' below.  On first loop
- * entry, the multiplexer is set to pin A0 and the ADC is triggered.  On second and subsequent
- * entries, the analogue value is read from the conversion register and then the multiplexer and
- * ADC are set up to read the next pin.
+ * The driver runs the ADC at its maximum rate of 860 samples/sec (1.16ms per sample).
+ * With a single input, the device is put into continuous-conversion mode and the conversion
+ * register is read once per conversion period.  With more than one input, a single-shot
+ * conversion is triggered on each input in turn, the next one being started as soon as the 
+ * previous result has been read.  So each input is sampled around every 1.5ms per input 
+ * configured on the device (at 400kHz I2C clock speed).
+ * 
+ * If the device's ALERT/RDY pin is connected to an Arduino pin, the driver uses it to detect 
+ * the end of a single-shot conversion, rather than waiting for the maximum conversion time.
+ * The RDY pin is used whenever it's configured, even with a single input.
  * 
  * The ADS111x is set up as follows:
- *    Single-shot scan
- *    Data rate 128 samples/sec (7.8ms/sample, but scanned every 10ms)
- *    Comparator off
+ *    Data rate 860 samples/sec
+ *    Comparator used as conversion-ready output if RDY pin configured, otherwise off
  *    Gain FSR=6.144V
  * The gain means that the maximum input voltage of 5V (when Vss=5V) gives a reading 
  * of 32767*(5.0/6.144) = 26666.
  * 
+ * The most recent IO_ANALOGUE_SAMPLES samples from each input are held, and the value returned
+ * by readAnalogue may be their average (filter=ADS111x::Average), their median 
+ * (filter=ADS111x::Median) or just the latest sample (filter=ADS111x::NoFilter).
+ * 
+ * An input may also be given a pair of thresholds, through 
+ *   IODevice::configureAnalogIn(vpin, lowThreshold, highThreshold);
+ * The digital state of the pin (as returned by IODevice::read) becomes 1 when the filtered value 
+ * rises to highThreshold or above, and 0 when it falls below lowThreshold.  Each change of state 
+ * is notified through IONotifyCallback, so the pin can be used as a Sensor input, for example
+ * for current-sensing block occupancy detectors.
+ * 
  * A device is configured by the following:
- *   ADS111x::create(firstVpin, nPins, i2cAddress);
+ *   ADS111x::create(firstVpin, nPins, i2cAddress [, rdyPin [, filter]]);
  * for example
  *   ADS111x::create(300, 1, 0x48);  // single-input ADS1113
  *   ADS111x::create(300, 4, 0x48);  // four-input ADS1115
+ *   ADS111x::create(300, 4, 0x48, 2, ADS111x::Median);  // ADS1115 with RDY on pin 2, median filter
  * 
  * Note: The device is simple and does not need initial configuration, so it should recover from
- * temporary loss of communications or power.
+ * temporary loss of communications or power.  If the RDY pin isn't signalled within a few 
+ * milliseconds (e.g. because the device has been reset), the conversion result is read anyway.
  **********************************************************************************************/
 class ADS111x: public IODevice { 
 public:
-  ADS111x(VPIN firstVpin, int nPins, uint8_t i2cAddress) {
+  enum FilterType : uint8_t {
+    NoFilter = 0,   // Return latest sample
+    Average = 1,    // Return moving average of samples
+    Median = 2,     // Return median of samples
+  };
+
+  ADS111x(VPIN firstVpin, int nPins, uint8_t i2cAddress, int rdyPin=-1, FilterType filter=NoFilter) {
     _firstVpin = firstVpin;
     _nPins = min(nPins,4);
     _i2cAddress = i2cAddress;
+    _rdyPin = rdyPin;
+    _filter = filter;
+    _continuous = (_nPins == 1 && _rdyPin < 0);
     _currentPin = 0;
-    for (int8_t i=0; i<_nPins; i++)
+    for (int8_t i=0; i<_nPins; i++) {
       _value[i] = -1;
+      _sampleIndex[i] = 0;
+      _sampleCount[i] = 0;
+      _lowThreshold[i] = _highThreshold[i] = 0;
+    }
+    _thresholdEnabled = 0;
+    _thresholdState = 0;
+    if (_filter != NoFilter)
+      _samples = (int16_t *)calloc(_nPins * IO_ANALOGUE_SAMPLES, sizeof(int16_t));
     addDevice(this);
   }
-  static void create(VPIN firstVpin, int nPins, uint8_t i2cAddress) {
-    new ADS111x(firstVpin, nPins, i2cAddress);
+  static void create(VPIN firstVpin, int nPins, uint8_t i2cAddress, int rdyPin=-1, FilterType filter=NoFilter) {
+    new ADS111x(firstVpin, nPins, i2cAddress, rdyPin, filter);
   }
 private:
   void _begin() {
     // Initialise ADS device
     if (I2CManager.exists(_i2cAddress)) {
+      if (_rdyPin >= 0) {
+        // Setting the MSB of the Hi_thresh register and clearing the MSB of Lo_thresh
+        // turns the comparator output into a conversion-ready signal.
+        pinMode(_rdyPin, INPUT_PULLUP);
+        I2CManager.write(_i2cAddress, 3, REG_LOTHRESH, 0x00, 0x00);
+        I2CManager.write(_i2cAddress, 3, REG_HITHRESH, 0x80, 0x00);
+      }
       _nextState = STATE_STARTSCAN;
 #ifdef DIAG_IO
       _display();
@@ -84,6 +132,16 @@ private:
       _deviceState = DEVSTATE_FAILED;
     }
   }
+
+  bool _configure(VPIN vpin, ConfigTypeEnum configType, int paramCount, int params[]) override {
+    if (configType != CONFIGURE_ANALOGINPUT || paramCount != 2) return false;
+    int pin = vpin - _firstVpin;
+    _lowThreshold[pin] = params[0];
+    _highThreshold[pin] = params[1];
+    _thresholdEnabled |= (1 << pin);
+    return true;
+  }
+
   void _loop(unsigned long currentMicros) override {
 
     // Check that previous non-blocking write has completed, if not then wait
@@ -92,34 +150,40 @@ private:
     if (status == I2C_STATUS_OK) {
       switch (_nextState) {
         case STATE_STARTSCAN:
-          // Configure ADC and multiplexer for next scan.  See ADS111x datasheet for details
-          // of configuration register settings.
-          _outBuffer[0] = 0x01; // Config register address
-          _outBuffer[1] = 0xC0 + (_currentPin << 4); // Trigger single-shot, channel n
-          _outBuffer[2] = 0xA3;           // 250 samples/sec, comparator off
-          // Write command, without waiting for completion.
-          I2CManager.write(_i2cAddress, _outBuffer, 3, &_i2crb);
-
-          delayUntil(currentMicros + scanInterval);
-          _nextState = STATE_STARTREAD;
+          startConversion(currentMicros);
           break;
 
         case STATE_STARTREAD:
+          // If the RDY pin is in use, wait until it goes low to indicate that the conversion 
+          // has finished, or until the timeout has elapsed.
+          if (_rdyPin >= 0 && digitalRead(_rdyPin) 
+              && currentMicros - _conversionStart < rdyTimeout) 
+            return;
           // Reading the pin value
-          _outBuffer[0] = 0x00;  // Conversion register address
+          _outBuffer[0] = REG_CONVERSION;
           I2CManager.read(_i2cAddress, _inBuffer, 2, _outBuffer, 1, &_i2crb); // Read register
           _nextState = STATE_GETVALUE;
           break;
 
         case STATE_GETVALUE:
-          _value[_currentPin] = ((uint16_t)_inBuffer[0] << 8) + (uint16_t)_inBuffer[1];
+          storeSample(((uint16_t)_inBuffer[0] << 8) + (uint16_t)_inBuffer[1]);
           #ifdef IO_ANALOGUE_SLOW
           DIAG(F("ADS111x pin:%d value:%d"), _currentPin, _value[_currentPin]);
           #endif
 
-          // Move to next pin
-          if (++_currentPin >= _nPins) _currentPin = 0;
-          _nextState = STATE_STARTSCAN;
+          if (_continuous) {
+            // Device continues converting, so read again after the next conversion.
+            delayUntil(currentMicros + conversionTime + scanInterval);
+            _nextState = STATE_STARTREAD;
+          } else {
+            // Move to next pin, and start the conversion straight away.
+            if (++_currentPin >= _nPins) _currentPin = 0;
+            if (scanInterval > 0) {
+              delayUntil(currentMicros + scanInterval);
+              _nextState = STATE_STARTSCAN;
+            } else 
+              startConversion(currentMicros);
+          }
           break;
         
         default:
@@ -131,6 +195,69 @@ private:
     }
   }
 
+  // Configure ADC and multiplexer for the current pin and start a conversion.  See ADS111x
+  // datasheet for details of configuration register settings.
+  void startConversion(unsigned long currentMicros) {
+    _outBuffer[0] = REG_CONFIG;
+    // Start conversion, single-ended channel n, FSR=6.144V, single-shot or continuous mode
+    _outBuffer[1] = 0xC0 + (_currentPin << 4) + (_continuous ? 0x00 : 0x01);
+    // 860 samples/sec, comparator asserts after one conversion (RDY) or is disabled.
+    _outBuffer[2] = (_rdyPin >= 0) ? 0xE0 : 0xE3;
+    // Write command, without waiting for completion.
+    I2CManager.write(_i2cAddress, _outBuffer, 3, &_i2crb);
+    _conversionStart = currentMicros;
+    // The conversion can't have completed until the minimum conversion time has elapsed.
+    delayUntil(currentMicros + (_rdyPin >= 0 ? minConversionTime : conversionTime));
+    _nextState = STATE_STARTREAD;
+  }
+
+  // Add a new sample to the current pin's ring buffer, update the filtered value
+  // and check for threshold crossings.
+  void storeSample(int16_t sample) {
+    uint8_t pin = _currentPin;
+    int16_t value = sample;
+    if (_samples) {
+      int16_t *samples = &_samples[pin * IO_ANALOGUE_SAMPLES];
+      samples[_sampleIndex[pin]] = sample;
+      if (++_sampleIndex[pin] >= IO_ANALOGUE_SAMPLES) _sampleIndex[pin] = 0;
+      if (_sampleCount[pin] < IO_ANALOGUE_SAMPLES) _sampleCount[pin]++;
+      uint8_t count = _sampleCount[pin];
+      if (_filter == Average) {
+        long total = 0;
+        for (uint8_t i=0; i<count; i++) total += samples[i];
+        value = total / count;
+      } else {
+        // Insertion sort a copy of the samples and take the middle one.
+        int16_t sorted[IO_ANALOGUE_SAMPLES];
+        for (uint8_t i=0; i<count; i++) {
+          uint8_t j = i;
+          for (; j>0 && sorted[j-1] > samples[i]; j--) 
+            sorted[j] = sorted[j-1];
+          sorted[j] = samples[i];
+        }
+        value = sorted[count/2];
+      }
+    }
+    _value[pin] = value;
+
+    // Check thresholds and notify changes of state.
+    uint8_t mask = 1 << pin;
+    if (_thresholdEnabled & mask) {
+      bool state = _thresholdState & mask;
+      bool newState = state ? (value >= _lowThreshold[pin]) : (value >= _highThreshold[pin]);
+      if (newState != state) {
+        _thresholdState ^= mask;
+        if (IONotifyCallback::hasCallback())
+          IONotifyCallback::invokeAll(_firstVpin+pin, newState);
+      }
+    }
+  }
+
+  int _read(VPIN vpin) override {
+    int pin = vpin - _firstVpin;
+    return (_thresholdState >> pin) & 1;
+  }
+
   int _readAnalogue(VPIN vpin) override {
     int pin = vpin - _firstVpin;
     return _value[pin];
@@ -141,23 +268,45 @@ private:
       _deviceState == DEVSTATE_FAILED ? F("OFFLINE") : F(""));
   }
 
-  // ADC conversion rate is 250SPS, or 4ms per conversion.  Set the period between updates to 10ms. 
-  // This is enough to allow the conversion to reliably complete in time.
+  // ADC conversion rate is 860SPS, or 1.16ms per conversion.  The internal oscillator may be 
+  // up to 10% slow, so allow 1.3ms for a conversion to complete.  When the RDY pin is used,
+  // it's first checked after 1ms and then on every loop entry.
+  const unsigned long conversionTime = 1300UL;
+  const unsigned long minConversionTime = 1000UL;
+  const unsigned long rdyTimeout = 5000UL;
+  // Additional delay between successive ADC scans in microseconds.
   #ifndef IO_ANALOGUE_SLOW
-  const unsigned long scanInterval = 10000UL;  // Period between successive ADC scans in microseconds.
+  const unsigned long scanInterval = 0;
   #else
-  const unsigned long scanInterval = 1000000UL;  // Period between successive ADC scans in microseconds.
+  const unsigned long scanInterval = 1000000UL;
   #endif
   enum : uint8_t {
     STATE_STARTSCAN,
     STATE_STARTREAD, 
     STATE_GETVALUE,
   };
-  uint16_t _value[4];
+  enum : uint8_t {
+    REG_CONVERSION = 0x00,
+    REG_CONFIG = 0x01,
+    REG_LOTHRESH = 0x02,
+    REG_HITHRESH = 0x03,
+  };
+  int16_t _value[4];
+  int16_t _lowThreshold[4];
+  int16_t _highThreshold[4];
+  int16_t *_samples = NULL;   // Ring buffers of IO_ANALOGUE_SAMPLES samples for each pin
+  uint8_t _sampleIndex[4];    // Next position in ring buffer for each pin
+  uint8_t _sampleCount[4];    // Number of samples in ring buffer for each pin
+  uint8_t _thresholdEnabled;  // Bit mask of pins with thresholds configured
+  uint8_t _thresholdState;    // Bit mask of pins at or above threshold
   uint8_t _i2cAddress;
   uint8_t _outBuffer[3];
   uint8_t _inBuffer[2];
   uint8_t _currentPin;  // ADC pin currently being scanned
+  int _rdyPin;
+  FilterType _filter;
+  bool _continuous;     // True if device is in continuous-conversion mode
+  unsigned long _conversionStart;
   I2CRB _i2crb;
   uint8_t _nextState;
 };
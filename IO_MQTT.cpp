@@ -26,12 +26,32 @@
  *  Currently only works with ethernet.  Will develop for wifi when I receive 
  *  the wifi shield.    
  *  Has not been tested with withrottle.
- *  When the command station starts up, the "begin" function will subscribe 
- *  to a list of sensors, so if one of those sensors change, its status will 
- *  be sent to the callback function, where it will be stored in an array 
- *  where it can be accessed by the read function. 
+ *  When the command station connects to the broker, it subscribes to all 
+ *  sensor topics with a single wildcard subscription (SENSORTOPIC followed 
+ *  by '#'), so if one of the sensors changes, its status will be sent to 
+ *  the callback function, where it will be stored in a bit array where it 
+ *  can be accessed by the read function.  Messages for sensor numbers 
+ *  outside the range configured for the device are ignored.
  *  
- *  The write function publishes turnout values to the MQTT broker. 
+ *  The write function queues turnout values for publishing to the MQTT 
+ *  broker.  Only the latest state of each turnout is kept, so repeated 
+ *  writes to the same turnout are coalesced, and the queue is sent from 
+ *  the loop function a few messages at a time, limited by 
+ *  MQTT_PUBLISH_BUDGET bytes per call, so that setting a route doesn't 
+ *  stall the command station.  Messages written while the broker is not 
+ *  connected are sent once the connection is made, and the last state of 
+ *  every turnout written is published again after each reconnection. 
+ *  
+ *  If MQTT_TELEMETRY is defined, the state of the layout is also published 
+ *  for dashboards, a few messages at a time within the same byte budget, 
+ *  after any queued turnout messages.  Every MQTT_TELEMETRY_INTERVAL ms the 
+ *  loco speed table and track power states are compared with what was last 
+ *  published, and any changes are published (retained):
+ *    LOCOTOPIC<loco>     {"speed":<0-126>,"dir":<1=fwd,0=rev>,"fn":<bits>}
+ *    POWERTOPIC"main"    ON, OFF or OVERLOAD (and likewise "prog")
+ *  and every MQTT_CURRENT_INTERVAL ms a current summary is published:
+ *    CURRENTTOPIC"main"  {"mA":<current>,"peak":<peak mA>,"trip":<trip mA>}
+ *  where the peak is the highest current seen since the previous summary. 
  *  
  *  If a sensor is sent to MQTT, it will be published with the message 
  *  "ACTIVE" for a one or "INACTIVE" for 0, preceded by topic 
@@ -41,11 +61,30 @@
 #include <Arduino.h>
 #include "IO_MQTT.h"
 #include "MiniBitSet.h"
+#ifdef MQTT_TELEMETRY
+#include "DCC.h"
+#include "DCCWaveform.h"
+#endif
 
 EthernetClient ethClient = EthernetServer(1883).available();
 myPubSubClient mqttClient(ethClient);
 MiniBitSet sensorData;
 uint16_t firstSensor;
+uint16_t sensorCount;
+MiniBitSet turnoutState;    // Last value written to each turnout
+MiniBitSet turnoutPending;  // Turnouts waiting to be published
+MiniBitSet turnoutKnown;    // Turnouts that have been written at least once
+uint16_t pendingCount = 0;
+uint16_t pendingCursor = 0; // Next turnout index to check for publishing
+
+#ifdef MQTT_TELEMETRY
+DCC::LOCO publishedLocos[MAX_LOCOS];  // Loco states as last published
+POWERMODE publishedPower[2];          // Main and prog power states as last published
+int peakCurrent[2];                   // Highest main and prog current since last summary
+uint8_t telemetryCursor = MAX_LOCOS+1;  // Next item to be checked in telemetry pass
+unsigned long lastTelemetryPass = 0;
+unsigned long lastCurrentSummary = 0;
+#endif
 
 // Constructor
 IO_MQTT::IO_MQTT(VPIN firstVpin, int nPins, int nTurnouts, int nSensors) {
@@ -54,6 +93,7 @@ IO_MQTT::IO_MQTT(VPIN firstVpin, int nPins, int nTurnouts, int nSensors) {
   _nTurnouts = nTurnouts;
   _nSensors = nSensors;
   firstSensor = firstVpin + nTurnouts;
+  sensorCount = nSensors;
   addDevice(this);
 }
 
@@ -61,7 +101,10 @@ IO_MQTT::IO_MQTT(VPIN firstVpin, int nPins, int nTurnouts, int nSensors) {
 // Static create method for one module.
 void IO_MQTT::create(VPIN firstVpin, int nPins, int nTurnouts, int nSensors) {
   new IO_MQTT(firstVpin, nPins, nTurnouts, nSensors);
-  sensorData.create(nSensors);  // create bit array
+  sensorData.create(nSensors);  // create bit arrays
+  turnoutState.create(nTurnouts);
+  turnoutPending.create(nTurnouts);
+  turnoutKnown.create(nTurnouts);
 }
 
 
@@ -83,34 +126,37 @@ void IO_MQTT::_begin() {
 }
 
 
-// Device-specific write function.  Write a string in the form "#Wm,n#"
-//  where m is the vpin number, and n is the value.
+// Device-specific write function.  Records the new state of the turnout 
+//  and marks it for publishing by the loop function.  Pins beyond the 
+//  turnouts are published immediately.
 void IO_MQTT::_write(VPIN vpin, int value) {
-  char topic[30];
   #ifdef DIAG_IO
   DIAG(F("IO_MQTT::_write Pin:%d Value:%d"), (int)vpin, value);
   #endif
-
-  sprintf(topic, "%s%d", TURNOUTTOPIC, (int)vpin); 
-  
-  if (value == 1)
-    _publish(topic, "THROWN");
-  else if (value == 0)
-    _publish(topic, "CLOSED");
+  if (value != 0 && value != 1) return;
+
+  uint16_t index = vpin - _firstVpin;
+  if (index < _nTurnouts) {
+    if (value)
+      turnoutState.set(index);
+    else
+      turnoutState.clear(index);
+    turnoutKnown.set(index);
+    if (!turnoutPending.get(index)) {
+      turnoutPending.set(index);
+      pendingCount++;
+    }
+  } else
+    _publishTurnout(vpin, value);
 }
 
 
 // Device-specific read function.
 int IO_MQTT::_read(VPIN vpin) {
-  uint16_t bitIndex = vpin - firstSensor;
-//  DIAG(F("IO_MQTT::_read vpin=%d bitIndex=%d"), (int)vpin, (int)bitIndex);
-  if ((bitIndex < 0) || (bitIndex > _nSensors))
+  uint16_t bitIndex = vpin - firstSensor;  // Wraps round if vpin < firstSensor
+  if (bitIndex >= _nSensors)
     return(0);
-  uint8_t value = sensorData.get(bitIndex);
-  DIAG(F("IO_MQTT::_read vpin=%d bitIndex=%d value=%d" )
-    , (int)vpin, (int)bitIndex, int(value));
-     
-  return((int)value);
+  return(sensorData.get(bitIndex) ? 1 : 0);
 }
 
 
@@ -125,58 +171,177 @@ void IO_MQTT::_loop(unsigned long currentMicros) {
     _reconnect();
   
   mqttClient.loop();
+
+  if (!mqttClient.connected()) return;
+
+  uint16_t bytesSent = 0;
+  if (pendingCount > 0)
+    bytesSent = _flush();
+#ifdef MQTT_TELEMETRY
+  if (bytesSent < MQTT_PUBLISH_BUDGET)
+    _publishTelemetry(bytesSent);
+#else
+  (void)bytesSent;
+#endif
+}
+
+
+// Publish pending turnout states, starting where the previous call left 
+//  off, until the queue is empty or MQTT_PUBLISH_BUDGET bytes have been sent.
+//  Returns the number of bytes sent.
+uint16_t IO_MQTT::_flush() {
+  uint16_t bytesSent = 0;
+  for (uint16_t checked = 0; checked < _nTurnouts && pendingCount > 0; checked++) {
+    uint16_t index = pendingCursor;
+    if (++pendingCursor >= _nTurnouts) pendingCursor = 0;
+    if (!turnoutPending.get(index)) continue;
+    int length = _publishTurnout(_firstVpin + index, turnoutState.get(index));
+    if (length == 0) break;  // Publish failed, try again next time.
+    turnoutPending.clear(index);
+    pendingCount--;
+    bytesSent += length;
+    if (bytesSent >= MQTT_PUBLISH_BUDGET) break;
+  }
+  return bytesSent;
 }
 
 
+#ifdef MQTT_TELEMETRY
+// Telemetry publishing.  A pass is started every MQTT_TELEMETRY_INTERVAL ms, 
+//  and checks each loco slot in turn, then the power state, publishing any 
+//  changes.  If the byte budget runs out, the pass continues on the next call.
+void IO_MQTT::_publishTelemetry(uint16_t bytesSent) {
+  static const char * const trackNames[2] = {"main", "prog"};
+  DCCWaveform *tracks[2] = {&DCCWaveform::mainTrack, &DCCWaveform::progTrack};
+  char topic[40];
+  char payload[48];
+  static_assert(sizeof(LOCOTOPIC) + 5 <= sizeof(topic), "LOCOTOPIC too long");
+  static_assert(sizeof(POWERTOPIC) + 4 <= sizeof(topic), "POWERTOPIC too long");
+  static_assert(sizeof(CURRENTTOPIC) + 4 <= sizeof(topic), "CURRENTTOPIC too long");
+  unsigned long now = millis();
+
+  for (uint8_t t=0; t<2; t++) {
+    int current = tracks[t]->getCurrentmA();
+    if (current > peakCurrent[t]) peakCurrent[t] = current;
+  }
+
+  if (telemetryCursor > MAX_LOCOS) {
+    // No pass in progress, check if it's time to start one.
+    if (now - lastTelemetryPass < MQTT_TELEMETRY_INTERVAL) return;
+    lastTelemetryPass = now;
+    telemetryCursor = 0;
+  }
+
+  while (bytesSent < MQTT_PUBLISH_BUDGET) {
+    if (telemetryCursor < MAX_LOCOS) {
+      // Check next loco slot
+      DCC::LOCO *sp = &DCC::speedTable[telemetryCursor];
+      DCC::LOCO *pp = &publishedLocos[telemetryCursor];
+      if (sp->loco > 0 && (sp->loco != pp->loco || sp->speedCode != pp->speedCode 
+          || sp->functions != pp->functions)) {
+        uint8_t speed = sp->speedCode & 0x7f;
+        snprintf(topic, sizeof(topic), "%s%d", LOCOTOPIC, sp->loco);
+        snprintf(payload, sizeof(payload), "{\"speed\":%d,\"dir\":%d,\"fn\":%lu}", 
+          speed > 1 ? speed-1 : 0, (sp->speedCode & 0x80) ? 1 : 0, sp->functions);
+        if (!_publish(topic, payload)) return;
+        bytesSent += MQTT_MAX_HEADER_SIZE + 2 + strlen(topic) + strlen(payload);
+      }
+      *pp = *sp;
+      telemetryCursor++;
+    } else {
+      // Check power states, and publish current summary if due.
+      for (uint8_t t=0; t<2; t++) {
+        POWERMODE mode = tracks[t]->getPowerMode();
+        if (mode != publishedPower[t]) {
+          snprintf(topic, sizeof(topic), "%s%s", POWERTOPIC, trackNames[t]);
+          const char *state = mode == POWERMODE::ON ? "ON" 
+              : mode == POWERMODE::OVERLOAD ? "OVERLOAD" : "OFF";
+          if (!_publish(topic, state)) return;
+          bytesSent += MQTT_MAX_HEADER_SIZE + 2 + strlen(topic) + strlen(state);
+          publishedPower[t] = mode;
+        }
+      }
+      if (now - lastCurrentSummary >= MQTT_CURRENT_INTERVAL) {
+        for (uint8_t t=0; t<2; t++) {
+          snprintf(topic, sizeof(topic), "%s%s", CURRENTTOPIC, trackNames[t]);
+          snprintf(payload, sizeof(payload), "{\"mA\":%d,\"peak\":%d,\"trip\":%d}", 
+            tracks[t]->getCurrentmA(), peakCurrent[t], tracks[t]->getTripmA());
+          if (!_publish(topic, payload, false)) return;  // a summary, not retained
+          bytesSent += MQTT_MAX_HEADER_SIZE + 2 + strlen(topic) + strlen(payload);
+          peakCurrent[t] = 0;
+        }
+        lastCurrentSummary = now;
+      }
+      telemetryCursor = MAX_LOCOS+1;  // Pass complete
+      return;
+    }
+  }
+}
+#endif
+
+
 void IO_MQTT::_display() {
   DIAG(F("IO_MQTT::_display Configured on VPins:%d-%d"), (int)_firstVpin, 
     (int)_firstVpin+_nPins-1);
 }
 
 
-void IO_MQTT::_publish(char* topic, char* payload) {
+// Publish the state of a turnout.  Returns the approximate number of bytes 
+//  sent, or zero if not sent.
+int IO_MQTT::_publishTurnout(VPIN vpin, int value) {
+  char topic[30];
+  snprintf(topic, sizeof(topic), "%s%d", TURNOUTTOPIC, (int)vpin); 
+#ifdef MQTT_COMPACT_PAYLOAD
+  const char *payload = value ? "1" : "0";
+#else
+  const char *payload = value ? "THROWN" : "CLOSED";
+#endif
+  if (!_publish(topic, payload)) return 0;
+  return MQTT_MAX_HEADER_SIZE + 2 + strlen(topic) + strlen(payload);
+}
+
+
+bool IO_MQTT::_publish(const char* topic, const char* payload, bool retained) {
   if (mqttClient.connected()) {
+    #ifdef DIAG_IO
     DIAG(F("IO_MQTT::publish Publish topic=%s payload=%s"), topic, payload);
-    mqttClient.publish(topic, payload, true);
+    #endif
+    return mqttClient.publish(topic, payload, retained);
   }
+  return false;
 }
 
 
-static void IO_MQTT::_callback(char* topic, byte* payload, unsigned int length) {
+void IO_MQTT::_callback(char* topic, byte* payload, unsigned int length) {
   /*
    * When a message is received that has been subscribed to, this function 
-   * will be called.  
+   * will be called.  The topic is expected to be SENSORTOPIC followed by 
+   * the sensor (Vpin) number, and the payload "ACTIVE" or "INACTIVE".
    */
-  uint16_t inID;
-  char* id;
-  char* msg;
-  // terminate the byte ar
-  payload[length] = 0;
-
-  DIAG(F("IO_MQTT::callback Message arrived, topic=%s payload=%s")
-    , topic, payload);
-
-  // copy the byte string to a char string
-  msg = (char *) payload;
-
-  // parse the first word from the incoming topic
-  strtok(topic, "/");
-
-  // parse until there are none left, outID will hold the ID number
-  while (id = strtok(NULL, "/"))
-    inID = atoi(id);
-
-  // set the appropriate output
-
-  DIAG(F("IO_MQTT::callback Sensor/Turnout number=%d %s"), (int)inID, payload);
-
-  if (!strcmp(payload, "ACTIVE"))
-    sensorData.set(inID - firstSensor);
-  if (!strcmp(payload, "INACTIVE"))
-    sensorData.clear(inID - firstSensor);
+  static const uint8_t prefixLength = sizeof(SENSORTOPIC)-1;
+  if (strncmp(topic, SENSORTOPIC, prefixLength) != 0)
+    return;
+
+  // Parse the sensor number from the rest of the topic.
+  const char *p = topic + prefixLength;
+  if (*p == 0) return;
+  uint16_t inID = 0;
+  for (; *p >= '0' && *p <= '9'; p++)
+    inID = inID * 10 + (*p - '0');
+  if (*p != 0) return;  // Not a number, or further levels in the topic
+
+  uint16_t bitIndex = inID - firstSensor;  // Wraps round if inID < firstSensor
+  if (bitIndex >= sensorCount)
+    return;
+
+  if (length == 6 && memcmp(payload, "ACTIVE", 6) == 0)
+    sensorData.set(bitIndex);
+  else if (length == 8 && memcmp(payload, "INACTIVE", 8) == 0)
+    sensorData.clear(bitIndex);
   
-  DIAG(F("IO_MQTT::callback Saved bit value=%d for sensor %d")
-    , sensorData.get(inID - firstSensor), inID);
+  #ifdef DIAG_IO
+  DIAG(F("IO_MQTT::callback Sensor:%d Value:%d"), (int)inID, sensorData.get(bitIndex));
+  #endif
 }
 
 
@@ -184,8 +349,6 @@ static void IO_MQTT::_callback(char* topic, byte* payload, unsigned int length)
 long lastReconnectAttempt = 0;
 
 void IO_MQTT::_reconnect() {
-    char topic[30];
-
   // check that a connection isnt already in progress
   if (mqttClient.state() != MQTT_CONNECT_INPROGRESS) {
     long now = millis();
@@ -209,15 +372,27 @@ void IO_MQTT::_reconnect() {
   switch (ret) {
     case MQTT_CONNECTED:
       DIAG(F("IO_MQTT::connectMqtt connected to MQTT broker at %s"), MQTTIP);
-      // DO WE NEED TO RESUBSCRIBE?
       lastReconnectAttempt = 0;
-      DIAG(F("IO_MQTT::_begin Subscribe for %d sensors with topic %s")
+      // Subscriptions are lost on reconnection, so subscribe to all
+      //  sensor topics again.
+      DIAG(F("IO_MQTT::connectMqtt Subscribe for %d sensors with topic %s#")
         , _nSensors, SENSORTOPIC);
+      mqttClient.subscribe(SENSORTOPIC "#");
+
+#ifdef MQTT_TELEMETRY
+      // Publish the full layout state again.
+      memset(publishedLocos, 0, sizeof(publishedLocos));
+      publishedPower[0] = publishedPower[1] = (POWERMODE)0xff;
+#endif
 
-      for (int i = 0; i < _nSensors; i++) {    
-        sprintf(topic, "%s%d", SENSORTOPIC, firstSensor + i); 
-        mqttClient.subscribe(topic);
-        DIAG(F("IO_MQTT::_begin subscribe, topic=%s"), topic);
+      // Queue the last known state of all turnouts for publishing again,
+      //  in case the broker has lost its retained messages.
+      pendingCount = 0;
+      for (uint16_t i = 0; i < _nTurnouts; i++) {
+        if (turnoutKnown.get(i)) {
+          turnoutPending.set(i);
+          pendingCount++;
+        }
       }
 
       break;
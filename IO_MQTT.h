@@ -31,6 +31,36 @@
 #ifndef IO_MQTT_H
 #define IO_MQTT_H
 
+#include "defines.h"  // brings in config.h, so the defaults below may be overridden there
+
+// Maximum number of bytes of queued turnout messages published per loop entry.
+#ifndef MQTT_PUBLISH_BUDGET
+#define MQTT_PUBLISH_BUDGET 128
+#endif
+
+// Uncomment following line to publish turnout states as "1" and "0" rather 
+// than "THROWN" and "CLOSED", to reduce the traffic to the broker.
+//#define MQTT_COMPACT_PAYLOAD
+
+// Define MQTT_TELEMETRY (e.g. in config.h) to publish loco, power and current 
+// information.  See IO_MQTT.cpp for details.  The topics and intervals may 
+// also be overridden in config.h.
+#ifndef LOCOTOPIC
+#define LOCOTOPIC "/trains/loco/"
+#endif
+#ifndef POWERTOPIC
+#define POWERTOPIC "/trains/power/"
+#endif
+#ifndef CURRENTTOPIC
+#define CURRENTTOPIC "/trains/current/"
+#endif
+#ifndef MQTT_TELEMETRY_INTERVAL
+#define MQTT_TELEMETRY_INTERVAL 250   // milliseconds between checks for changes
+#endif
+#ifndef MQTT_CURRENT_INTERVAL
+#define MQTT_CURRENT_INTERVAL 5000    // milliseconds between current summaries
+#endif
+
 #include "IODevice.h"
 #include <Ethernet.h>
 #include "myPubSubClient.h"
@@ -48,7 +78,12 @@ protected:
   void _display() override;
     
 private:
-  void _publish(char* topic, char* payload);
+  bool _publish(const char* topic, const char* payload, bool retained=true);
+  int _publishTurnout(VPIN vpin, int value);
+  uint16_t _flush();
+#ifdef MQTT_TELEMETRY
+  void _publishTelemetry(uint16_t bytesSent);
+#endif
   static void _callback(char* topic, byte* payload, unsigned int length);
   void _reconnect();
 
@@ -20,6 +20,7 @@
 #include "IODevice.h"
 #include "I2CManager.h"
 #include "DIAG.h"
+#include "ObjectPool.h"
 
 // REGISTER ADDRESSES
 static const byte PCA9685_MODE1=0x00;      // Mode Register 
@@ -31,6 +32,10 @@ static const byte MODE1_AI=0x20;      /**< Auto-Increment enabled */
 static const byte MODE1_RESTART=0x80; /**< Restart enabled */
 
 static const float FREQUENCY_OSCILLATOR=25000000.0; /** Accurate enough for our purposes  */
+
+// Servo data is only allocated for pins in use, from a pool shared by all PCA9685s.
+static const char servoDataPoolName[] FLASH = "ServoData";
+ObjectPool PCA9685::_servoDataPool((const FSH *)servoDataPoolName, sizeof(ServoData), 16);
 static const uint8_t PRESCALE_50HZ = (uint8_t)(((FREQUENCY_OSCILLATOR / (50.0 * 4096.0)) + 0.5) - 1);
 static const uint32_t MAX_I2C_SPEED = 1000000L; // PCA9685 rated up to 1MHz I2C clock speed
 
@@ -54,7 +59,7 @@ bool PCA9685::_configure(VPIN vpin, ConfigTypeEnum configType, int paramCount, i
   int8_t pin = vpin - _firstVpin;
   struct ServoData *s = _servoData[pin];
   if (s == NULL) { 
-    _servoData[pin] = (struct ServoData *)calloc(1, sizeof(struct ServoData));
+    _servoData[pin] = (struct ServoData *)_servoDataPool.allocate();
     s = _servoData[pin];
     if (!s) return false; // Check for failed memory allocation
   }
@@ -83,9 +88,6 @@ PCA9685::PCA9685(VPIN firstVpin, int nPins, uint8_t I2CAddress) {
     _servoData[i] = NULL;
 
   addDevice(this);
-
-  // Initialise structure used for setting pulse rate
-  requestBlock.setWriteParams(_I2CAddress, outputBuffer, sizeof(outputBuffer));
 }
 
 // Device-specific initialisation
@@ -101,6 +103,9 @@ void PCA9685::_begin() {
     writeRegister(_I2CAddress, PCA9685_PRESCALE, PRESCALE_50HZ);   // 50Hz clock, 20ms pulse period.
     writeRegister(_I2CAddress, PCA9685_MODE1, MODE1_AI);
     writeRegister(_I2CAddress, PCA9685_MODE1, MODE1_RESTART | MODE1_AI);
+    // Allocate buffer for the auto-increment transfers issued by writeDevice.
+    _outputBuffer = (uint8_t *)calloc(1 + 4 * _nPins, 1);
+    if (!_outputBuffer) _deviceState = DEVSTATE_FAILED;
     // In theory, we should wait 500us before sending any other commands to each device, to allow
     // the PWM oscillator to get running.  However, we don't do any specific wait, as there's 
     // plenty of other stuff to do before we will send a command.
@@ -134,12 +139,18 @@ void PCA9685::_write(VPIN vpin, int value) {
 // Profile is as follows:
 //  Bit 7:     0=Set PWM to 0% to power off servo motor when finished
 //             1=Keep PWM pulses on (better when using PWM to drive an LED)
-//  Bits 6-0:  0           Use specified duration (defaults to 0 deciseconds)
+//  Bits 5-4:  0           Linear movement
+//             1 (EaseIn)  Start slowly and accelerate
+//             2 (EaseOut) Decelerate towards the end
+//             3 (EaseInOut) Accelerate then decelerate
+//  Bits 3-0:  0           Use specified duration (defaults to 0 deciseconds)
 //             1 (Fast)    Move servo in 0.5 seconds
 //             2 (Medium)  Move servo in 1.0 seconds
 //             3 (Slow)    Move servo in 2.0 seconds
-//             4 (Bounce)  Servo 'bounces' at extremes.
-//            
+//             4 (Bounce)  Servo 'bounces' at extremes (easing bits are ignored).
+// The number of steps is derived from the duration and the refresh interval
+// (IO_SERVO_REFRESH_MS), so the duration is the same whatever the refresh rate.
+//
 void PCA9685::_writeAnalogue(VPIN vpin, int value, uint8_t profile, uint16_t duration) {
   #ifdef DIAG_IO
   DIAG(F("PCA9685 WriteAnalogue Vpin:%d Value:%d Profile:%d Duration:%d %S"), 
@@ -153,7 +164,7 @@ void PCA9685::_writeAnalogue(VPIN vpin, int value, uint8_t profile, uint16_t dur
   struct ServoData *s = _servoData[pin];
   if (s == NULL) {
     // Servo pin not configured, so configure now using defaults
-    s = _servoData[pin] = (struct ServoData *) calloc(sizeof(struct ServoData), 1);
+    s = _servoData[pin] = (struct ServoData *)_servoDataPool.allocate();
     if (s == NULL) return;  // Check for memory allocation failure
     s->activePosition = 4095;
     s->inactivePosition = 0;
@@ -163,12 +174,18 @@ void PCA9685::_writeAnalogue(VPIN vpin, int value, uint8_t profile, uint16_t dur
 
   // Animated profile.  Initiate the appropriate action.
   s->currentProfile = profile;
-  uint8_t profileValue = profile & ~NoPowerOff;  // Mask off 'don't-power-off' bit.
-  s->numSteps = profileValue==Fast ? 10 :   // 0.5 seconds
-                profileValue==Medium ? 20 : // 1.0 seconds
-                profileValue==Slow ? 40 :   // 2.0 seconds
-                profileValue==Bounce ? sizeof(_bounceProfile)-1 : // ~ 1.5 seconds
-                duration * 2 + 1; // Convert from deciseconds (100ms) to refresh cycles (50ms)
+  uint8_t profileValue = profile & 0x0f;  // Mask off easing and 'don't-power-off' bits.
+  uint32_t durationMs = profileValue==Fast ? 500 :
+                profileValue==Medium ? 1000 :
+                profileValue==Slow ? 2000 :
+                profileValue==Bounce ? _bounceDuration :
+                duration * 100UL; // Convert from deciseconds (100ms) to milliseconds
+  // Convert to refresh cycles, with a minimum of one to output the final position.
+  s->numSteps = durationMs / refreshInterval;
+  if (s->numSteps == 0) s->numSteps = 1;
+  // Fraction of movement per step, as a 16-bit fixed-point value.  Not used 
+  //  when there is only one step, since the last step outputs the target position.
+  s->stepIncrement = 65536UL / s->numSteps;
   s->stepNumber = 0;
   s->toPosition = value;
   s->fromPosition = s->currentPosition;
@@ -187,20 +204,28 @@ int PCA9685::_read(VPIN vpin) {
 }
 
 void PCA9685::_loop(unsigned long currentMicros) {
+  // Calculate new positions for all animated pins, and note the range of 
+  //  pins that have changed so that they can be written in one transfer.
+  int8_t firstPin = -1, lastPin = -1;
   for (int pin=0; pin<_nPins; pin++) {
-    updatePosition(pin);
+    if (updatePosition(pin)) {
+      if (firstPin < 0) firstPin = pin;
+      lastPin = pin;
+    }
   }
+  if (firstPin >= 0) writeDevice(firstPin, lastPin);
   delayUntil(currentMicros + refreshInterval * 1000UL);
 }
 
-// Private function to reposition servo
+// Private function to step the animation for a pin.  Returns true if the
+// PWM output for the pin needs to be written to the device.
 // TODO: Could calculate step number from elapsed time, to allow for erratic loop timing.
-void PCA9685::updatePosition(uint8_t pin) {
+bool PCA9685::updatePosition(uint8_t pin) {
   struct ServoData *s = _servoData[pin];
   
-  if (s == NULL) return; // No pin configuration/state data
+  if (s == NULL) return false; // No pin configuration/state data
 
-  if (s->numSteps == 0) return; // No animation in progress
+  if (s->numSteps == 0) return false; // No animation in progress
 
   if (s->stepNumber == 0 && s->fromPosition == s->toPosition) {
     // Go straight to end of sequence, output final position.
@@ -210,37 +235,72 @@ void PCA9685::updatePosition(uint8_t pin) {
   if (s->stepNumber < s->numSteps) {
     // Animation in progress, reposition servo
     s->stepNumber++;
-    if ((s->currentProfile & ~NoPowerOff) == Bounce) {
-      // Retrieve step positions from array in flash
-      byte profileValue = GETFLASH(&_bounceProfile[s->stepNumber]);
-      s->currentPosition = map(profileValue, 0, 100, s->fromPosition, s->toPosition);
-    } else {
-      // All other profiles - calculate step by linear interpolation between from and to positions.
-      s->currentPosition = map(s->stepNumber, 0, s->numSteps, s->fromPosition, s->toPosition);
-    }
-    // Send servo command
-    writeDevice(pin, s->currentPosition);
+    s->currentPosition = interpolate(s);
+    s->outputOff = 0;
+    return true;
   } else if (s->stepNumber < s->numSteps + _catchupSteps) {
     // We've finished animation, wait a little to allow servo to catch up
     s->stepNumber++;
-  } else if (s->stepNumber == s->numSteps + _catchupSteps 
-            && s->currentPosition != 0) {
+  } else {
+    s->numSteps = 0;  // Done now.
 #ifdef IO_SWITCH_OFF_SERVO
-    if ((s->currentProfile & NoPowerOff) == 0) {
+    if ((s->currentProfile & NoPowerOff) == 0 && s->currentPosition != 0) {
       // Wait has finished, so switch off PWM to prevent annoying servo buzz
-      writeDevice(pin, 0);
+      s->outputOff = 1;
+      return true;
     }
 #endif
-    s->numSteps = 0;  // Done now.
   }
+  return false;
 }
 
-// writeDevice takes a pin in range 0 to _nPins-1 within the device, and a value
-// between 0 and 4095 for the PWM mark-to-period ratio, with 4095 being 100%.
-void PCA9685::writeDevice(uint8_t pin, int value) {
+// Private function to calculate the position of a servo for the current step of 
+// its animation.  Fixed-point arithmetic is used throughout: the progress through the
+// animation is a fraction in 1/65536ths, and the easing curves give the proportion of 
+// the movement completed in 1/4096ths.
+uint16_t PCA9685::interpolate(struct ServoData *s) {
+  if (s->stepNumber >= s->numSteps) return s->toPosition;
+  uint16_t progress = s->stepNumber * s->stepIncrement;
+
+  const uint16_t *curve;
+  uint8_t segments = _curveSegments;
+  if ((s->currentProfile & 0x0f) == Bounce) {
+    curve = _bounceProfile;
+    segments = sizeof(_bounceProfile)/sizeof(_bounceProfile[0]) - 1;
+  } else {
+    switch (s->currentProfile & EaseInOut) {
+      case EaseIn: curve = _easeInCurve; break;
+      case EaseOut: curve = _easeOutCurve; break;
+      case EaseInOut: curve = _easeInOutCurve; break;
+      default: curve = NULL; break;
+    }
+  }
+
+  int32_t fraction;
+  if (curve) {
+    // Locate the curve segment, and interpolate linearly within it.
+    uint32_t position = (uint32_t)progress * segments;
+    uint8_t index = position >> 16;
+    uint16_t segmentFraction = position & 0xffff;
+    int16_t start = GETFLASHW(&curve[index]);
+    int16_t end = GETFLASHW(&curve[index+1]);
+    fraction = start + (((int32_t)(end - start) * segmentFraction) >> 16);
+  } else 
+    fraction = progress >> 4;  // Linear, so just reduce to 1/4096ths
+
+  int16_t from = s->fromPosition, to = s->toPosition;
+  return from + (((int32_t)(to - from) * fraction) >> 12);
+}
+
+// writeDevice sends the PWM values for pins firstPin to lastPin (in the range 0 to 
+// _nPins-1) to the device in a single auto-increment write.  Each value is between
+// 0 and 4095 for the PWM mark-to-period ratio, with 4095 being 100%.  Pins which 
+// are not in use, or which have been switched off, are sent a value of 0.
+void PCA9685::writeDevice(uint8_t firstPin, uint8_t lastPin) {
   #ifdef DIAG_IO
-  DIAG(F("PCA9685 I2C:x%x WriteDevice Pin:%d Value:%d"), _I2CAddress, pin, value);
+  DIAG(F("PCA9685 I2C:x%x WriteDevice Pins:%d-%d"), _I2CAddress, firstPin, lastPin);
   #endif
+  if (!_outputBuffer) return;
   // Wait for previous request to complete
   uint8_t status = requestBlock.wait();
   if (status != I2C_STATUS_OK) {
@@ -248,11 +308,17 @@ void PCA9685::writeDevice(uint8_t pin, int value) {
     DIAG(F("PCA9685 I2C:x%x failed %S"), _I2CAddress, I2CManager.getErrorMessage(status));
   } else {
     // Set up new request.
-    outputBuffer[0] = PCA9685_FIRST_SERVO + 4 * pin;
-    outputBuffer[1] = 0;
-    outputBuffer[2] = (value == 4095 ? 0x10 : 0);  // 4095=full on
-    outputBuffer[3] = value & 0xff;
-    outputBuffer[4] = value >> 8;
+    uint8_t *ptr = _outputBuffer;
+    *ptr++ = PCA9685_FIRST_SERVO + 4 * firstPin;
+    for (uint8_t pin=firstPin; pin<=lastPin; pin++) {
+      struct ServoData *s = _servoData[pin];
+      uint16_t value = (s && !s->outputOff) ? s->currentPosition : 0;
+      *ptr++ = 0;
+      *ptr++ = (value == 4095 ? 0x10 : 0);  // 4095=full on
+      *ptr++ = value & 0xff;
+      *ptr++ = value >> 8;
+    }
+    requestBlock.setWriteParams(_I2CAddress, _outputBuffer, ptr - _outputBuffer);
     I2CManager.queueRequest(&requestBlock);
   }
 }
@@ -268,9 +334,33 @@ static void writeRegister(byte address, byte reg, byte value) {
   I2CManager.write(address, 2, reg, value);
 }
 
+// Easing curves, calculated at compile time.  Each gives the proportion of the 
+// movement (0-4096) completed at each of the _curveSegments+1 equally spaced points in 
+// the animation.
+static constexpr uint16_t easeIn(uint32_t i) {
+  return 4096UL * i * i / (16 * 16);
+}
+static constexpr uint16_t easeOut(uint32_t i) {
+  return 4096 - easeIn(16 - i);
+}
+static constexpr uint16_t easeInOut(uint32_t i) {
+  return 4096UL * (3 * 16 * i * i - 2 * i * i * i) / (16 * 16 * 16);
+}
+#define CURVE(f) { f(0), f(1), f(2), f(3), f(4), f(5), f(6), f(7), f(8), \
+                   f(9), f(10), f(11), f(12), f(13), f(14), f(15), f(16) }
+const uint16_t FLASH PCA9685::_easeInCurve[_curveSegments+1] = CURVE(easeIn);
+const uint16_t FLASH PCA9685::_easeOutCurve[_curveSegments+1] = CURVE(easeOut);
+const uint16_t FLASH PCA9685::_easeInOutCurve[_curveSegments+1] = CURVE(easeInOut);
+
 // Profile for a bouncing signal or turnout
 // The profile below is in the range 0-100% and should be combined with the desired limits
 // of the servo set by _activePosition and _inactivePosition.  The profile is symmetrical here,
-// i.e. the bounce is the same on the down action as on the up action.  First entry isn't used.
-const byte FLASH PCA9685::_bounceProfile[30] = 
-    {0,2,3,7,13,33,50,83,100,83,75,70,65,60,60,65,74,84,100,83,75,70,70,72,75,80,87,92,97,100};
+// i.e. the bounce is the same on the down action as on the up action.  The percentages
+// are converted to 1/4096ths at compile time, and the profile is spread evenly
+// over _bounceDuration.
+static constexpr uint16_t pc(uint32_t percent) {
+  return percent * 4096 / 100;
+}
+const uint16_t FLASH PCA9685::_bounceProfile[30] = 
+    {pc(0),pc(2),pc(3),pc(7),pc(13),pc(33),pc(50),pc(83),pc(100),pc(83),pc(75),pc(70),pc(65),pc(60),pc(60),
+     pc(65),pc(74),pc(84),pc(100),pc(83),pc(75),pc(70),pc(70),pc(72),pc(75),pc(80),pc(87),pc(92),pc(97),pc(100)};
@@ -0,0 +1,91 @@
+/*
+ *  © 2026 agent
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "ObjectPool.h"
+#include "StringFormatter.h"
+
+ObjectPool * ObjectPool::_firstPool=NULL;
+
+ObjectPool::ObjectPool(const FSH * name, size_t objectSize, uint8_t perSlab) {
+  _name=name;
+  // Free objects hold the free list pointer, so must be at least that big.
+  _objectSize=(objectSize < sizeof(FreeObject)) ? sizeof(FreeObject) : objectSize;
+  _perSlab=perSlab;
+  _slabCount=0;
+  _inUse=0;
+  _slabs=NULL;
+  _freeList=NULL;
+  _nextPool=_firstPool;
+  _firstPool=this;
+}
+
+void * ObjectPool::allocate(size_t size) {
+  // Anything bigger than the pool was set up for comes from the heap instead.
+  if (size > _objectSize) return calloc(1, size);
+
+  if (!_freeList) {
+    // Add a new slab and put all its objects on the free list.
+    Slab * slab=(Slab *)malloc(sizeof(Slab) + (size_t)_perSlab * _objectSize);
+    if (!slab) return NULL;
+    slab->next=_slabs;
+    _slabs=slab;
+    _slabCount++;
+    byte * object=(byte *)(slab+1);
+    for (uint8_t i=0; i<_perSlab; i++, object+=_objectSize) {
+      ((FreeObject *)object)->next=_freeList;
+      _freeList=(FreeObject *)object;
+    }
+  }
+  FreeObject * object=_freeList;
+  _freeList=object->next;
+  _inUse++;
+  memset(object, 0, _objectSize);
+  return object;
+}
+
+void ObjectPool::release(void * object) {
+  if (!object) return;
+  if (!owns(object)) {
+    free(object);  // came from the heap (see allocate)
+    return;
+  }
+  ((FreeObject *)object)->next=_freeList;
+  _freeList=(FreeObject *)object;
+  _inUse--;
+}
+
+bool ObjectPool::owns(void * object) {
+  for (Slab * slab=_slabs; slab; slab=slab->next) {
+    byte * first=(byte *)(slab+1);
+    if ((byte *)object >= first && (byte *)object < first + (size_t)_perSlab * _objectSize)
+      return true;
+  }
+  return false;
+}
+
+// <D POOLS> Show each pool's object size, objects in use, slots free for reuse
+// and the heap taken by its slabs.
+void ObjectPool::printAll(Print * stream) {
+  for (ObjectPool * pool=_firstPool; pool; pool=pool->_nextPool) {
+    uint16_t slots=pool->_slabCount * pool->_perSlab;
+    StringFormatter::send(stream, F("Pool %S size=%d used=%d free=%d slabs=%d bytes=%d\n"),
+      pool->_name, pool->_objectSize, pool->_inUse, slots - pool->_inUse,
+      pool->_slabCount, pool->_slabCount * (sizeof(Slab) + pool->_perSlab * pool->_objectSize));
+  }
+}
@@ -0,0 +1,67 @@
+/*
+ *  © 2026 agent
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef ObjectPool_h
+#define ObjectPool_h
+#include <Arduino.h>
+#include "FSH.h"
+
+/*
+ * Pool of same sized objects, for the things that are created and deleted
+ * while running (turnouts, sensors, outputs, EX-RAIL tasks, throttles...).
+ * Objects are carved out of slabs of perSlab objects, and deleted objects
+ * go onto a free list for reuse, so the heap only ever sees a few slab
+ * sized blocks instead of lots of small ones coming and going.
+ * Slabs are never given back.
+ *
+ * Use as
+ *    static ObjectPool pool(name, sizeof(Thing), 8);
+ *    Thing * t=(Thing *)pool.allocate();   // zeroed, like calloc
+ *    pool.release(t);
+ * or from a class's operator new/delete.
+ * <D POOLS> lists the pools with their occupancy.
+ */
+class ObjectPool {
+  public:
+    ObjectPool(const FSH * name, size_t objectSize, uint8_t perSlab);
+    void * allocate(size_t size);
+    inline void * allocate() { return allocate(_objectSize); }
+    void release(void * object);
+    static void printAll(Print * stream);
+
+  private:
+    struct Slab {
+      Slab * next;
+      // objects follow
+    };
+    struct FreeObject {
+      FreeObject * next;
+    };
+    bool owns(void * object);
+    const FSH * _name;
+    uint16_t _objectSize;
+    uint8_t _perSlab;
+    uint16_t _slabCount;
+    uint16_t _inUse;
+    Slab * _slabs;
+    FreeObject * _freeList;
+    ObjectPool * _nextPool;
+    static ObjectPool * _firstPool;
+};
+#endif
@@ -91,6 +91,11 @@ the state of any outputs being monitored or controlled by a separate interface o
 #endif
 #include "StringFormatter.h"
 #include "IODevice.h"
+#include "ObjectPool.h"
+
+// Outputs are allocated from a pool, as for Sensors.
+static const char outputPoolName[] FLASH = "Output";
+static ObjectPool outputPool((const FSH *)outputPoolName, sizeof(Output), 8);
 
 ///////////////////////////////////////////////////////////////////////////////
 // Static function to print all output states to stream in the form "<Y id state>"
@@ -111,7 +116,7 @@ void  Output::activate(uint16_t s){
 #ifndef DISABLE_EEPROM
   // Update EEPROM if output has been stored.    
   if(EEStore::eeStore->data.nOutputs > 0 && num > 0)
-    EEPROM.put(num, data.oStatus);
+    EEStore::putState(num, data.oStatus);
 #endif
 }
 
@@ -141,7 +146,7 @@ bool Output::remove(uint16_t n){
   else
     pp->nextOutput=tt->nextOutput;
 
-  free(tt);
+  outputPool.release(tt);
 
   return true;
   }
@@ -149,20 +154,34 @@ bool Output::remove(uint16_t n){
 ///////////////////////////////////////////////////////////////////////////////
 // Static function to load configuration and state of all Outputs from EEPROM
 #ifndef DISABLE_EEPROM
+// Outputs are loaded in stored order onto the end of the list.  The stored
+// ids are unique, so there is no need to look for existing outputs as 
+// create() does, and the pins are written once all are loaded.
 void Output::load(){
-  struct OutputData data;
-  Output *tt;
+  Output *last=NULL;
+  for (Output *tt=firstOutput; tt!=NULL; tt=tt->nextOutput) last=tt;
+  Output *firstLoaded=NULL;
 
   for(uint16_t i=0;i<EEStore::eeStore->data.nOutputs;i++){
-    EEPROM.get(EEStore::pointer(),data);
-    // Create new object, set current state to default or to saved state from eeprom.
-    tt=create(data.id, data.pin, data.flags);
-    uint8_t state = data.setDefault ? data.defaultValue : data.active;
-    tt->activate(state);
-
-    if (tt) tt->num=EEStore::pointer() + offsetof(OutputData, oStatus); // Save pointer to flags within EEPROM
+    Output *tt=(Output *)outputPool.allocate();
+    if (!tt) {
+      // Memory allocation failure, so skip this record and the rest.
+      EEStore::advance((EEStore::eeStore->data.nOutputs-i)*sizeof(OutputData));
+      EEStore::loadIncomplete=true;
+      break;
+    }
+    EEPROM.get(EEStore::pointer(),tt->data);
+    // Set current state to default or to saved state from eeprom.
+    if (tt->data.setDefault) tt->data.active = tt->data.defaultValue;
+    tt->num=EEStore::pointer() + offsetof(OutputData, oStatus); // Save pointer to flags within EEPROM
     EEStore::advance(sizeof(tt->data));
+    if (last) last->nextOutput=tt;
+    else firstOutput=tt;
+    last=tt;
+    if (!firstLoaded) firstLoaded=tt;
   }
+  for (Output *tt=firstLoaded; tt!=NULL; tt=tt->nextOutput) 
+    IODevice::write(tt->data.pin, tt->data.active ^ tt->data.invert);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -196,13 +215,13 @@ Output *Output::create(uint16_t id, VPIN pin, int iFlag, int v){
   if (pin > VPIN_MAX) return NULL;
   
   if(firstOutput==NULL){
-    firstOutput=(Output *)calloc(1,sizeof(Output));
+    firstOutput=(Output *)outputPool.allocate();
     tt=firstOutput;
   } else if((tt=get(id))==NULL){
     tt=firstOutput;
     while(tt->nextOutput!=NULL)
       tt=tt->nextOutput;
-    tt->nextOutput=(Output *)calloc(1,sizeof(Output));
+    tt->nextOutput=(Output *)outputPool.allocate();
     tt=tt->nextOutput;
   }
 
@@ -46,6 +46,26 @@ size_t RingStream::write(uint8_t b) {
   return 1;
 }
 
+// Block write, copied in at most two parts.  Behaves exactly as writing
+// the bytes one at a time, including where the buffer fills up.
+size_t RingStream::write(const uint8_t * buffer, size_t size) {
+  if (_overflow) return 0;
+  size_t space=(_pos_read>_pos_write) ? _pos_read-_pos_write : _len-_pos_write+_pos_read;
+  size_t copy=(size<space) ? size : space;
+  size_t block=_len-_pos_write;
+  if (block>copy) block=copy;
+  memcpy(_buffer+_pos_write, buffer, block);
+  memcpy(_buffer, buffer+block, copy-block);
+  _pos_write+=copy;
+  if (_pos_write>=_len) _pos_write-=_len;
+  if (copy==space) {
+    _overflow=true;   // the last byte filled the buffer, as in write(b)
+    copy--;
+  }
+  _count+=copy;
+  return copy;
+}
+
 int RingStream::read() {
   if ((_pos_read==_pos_write) && !_overflow) return -1;  // empty  
   byte b=_buffer[_pos_read];
@@ -60,6 +80,32 @@ int RingStream::count() {
   return (read()<<8) | read(); 
   }
 
+// look at a byte ahead of the read position without consuming it
+int RingStream::peek(int offset) {
+  int available=_pos_write-_pos_read;
+  if (available<0 || (available==0 && _overflow)) available+=_len;
+  if (offset<0 || offset>=available) return -1;
+  int pos=_pos_read+offset;
+  if (pos>=_len) pos-=_len;
+  return _buffer[pos];
+}
+
+// read count bytes straight out to stream, in at most two block writes
+int RingStream::transfer(Print * stream, int count) {
+  int done=0;
+  while (count>0 && !((_pos_read==_pos_write) && !_overflow)) {
+    int block=((_pos_read<_pos_write)?_pos_write:_len)-_pos_read;
+    if (block>count) block=count;
+    stream->write(_buffer+_pos_read,block);
+    _pos_read+=block;
+    if (_pos_read==_len) _pos_read=0;
+    _overflow=false;
+    count-=block;
+    done+=block;
+  }
+  return done;
+}
+
 int RingStream::freeSpace() {
   // allow space for client flag and length bytes
   if (_pos_read>_pos_write) return _pos_read-_pos_write-3;
@@ -67,7 +113,7 @@ int RingStream::freeSpace() {
 }
 
 
-// mark start of message with client id (0...9)
+// mark start of message with client id (0...MAX_NUM_TCP_CLIENTS-1)
 void RingStream::mark(uint8_t b) {
     _mark=_pos_write;
     write(b); // client id
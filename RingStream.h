@@ -28,9 +28,12 @@ class RingStream : public Print {
     RingStream( const uint16_t len);
   
     virtual size_t write(uint8_t b);
+    virtual size_t write(const uint8_t * buffer, size_t size);
     using Print::write;
     int read();
     int count();
+    int peek(int offset);
+    int transfer(Print * stream, int count);
     int freeSpace();
     void mark(uint8_t b);
     bool commit();
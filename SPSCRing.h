@@ -0,0 +1,109 @@
+/*
+ *  © 2026 agent
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef SPSCRing_h
+#define SPSCRing_h
+#include <Arduino.h>
+#include "StringFormatter.h"
+
+/*
+ * Fixed size queue for handing items between exactly one producer and one
+ * consumer, where one of them may be an interrupt routine.  Neither side
+ * ever blocks or disables interrupts: the producer only writes head and
+ * the consumer only writes tail, and both are single bytes so are read
+ * and written in one instruction.
+ *
+ * SIZE must be a power of 2, up to 128.  head and tail run freely from
+ * 0 to 255 and wrap, so head-tail is always the number of items queued.
+ *
+ * highWater is the most items ever queued at once and overflows counts
+ * the pushes that found the ring full, so <D QUEUES> can show how near
+ * each queue has come to overrunning.
+ */
+
+// Stop the compiler moving buffer accesses across an index update.
+#define SPSC_BARRIER __asm__ __volatile__("" ::: "memory")
+
+template <typename T, uint8_t SIZE>
+class SPSCRing {
+  static_assert(SIZE > 0 && SIZE <= 128 && (SIZE & (SIZE - 1)) == 0,
+                "SPSCRing SIZE must be a power of 2 up to 128");
+  public:
+    static const uint8_t CAPACITY = SIZE;
+
+    SPSCRing() {
+      _head = 0;
+      _tail = 0;
+      _highWater = 0;
+      _overflows = 0;
+    }
+
+    // Producer side.  Returns false (and counts an overflow) if full.
+    bool push(const T & item) {
+      uint8_t head = _head;
+      uint8_t used = head - _tail;
+      if (used == SIZE) {
+        _overflows++;
+        return false;
+      }
+      _buffer[head & (SIZE - 1)] = item;
+      SPSC_BARRIER;
+      _head = head + 1;
+      if (used >= _highWater) _highWater = used + 1;
+      return true;
+    }
+    inline bool full() { return (uint8_t)(_head - _tail) == SIZE; }
+
+    // Consumer side.  front() gives the oldest item, to be used in place
+    // before pop() hands its slot back to the producer.
+    inline bool empty() { return _head == _tail; }
+    inline T * front() { return empty() ? NULL : &_buffer[_tail & (SIZE - 1)]; }
+    inline void pop() {
+      SPSC_BARRIER;
+      _tail++;
+    }
+    bool pop(T & item) {
+      if (empty()) return false;
+      item = _buffer[_tail & (SIZE - 1)];
+      pop();
+      return true;
+    }
+
+    // Either side
+    inline uint8_t count() { return (uint8_t)(_head - _tail); }
+    inline uint8_t getHighWater() { return _highWater; }
+    uint16_t getOverflows() {
+      // 16 bits may be torn by a producer interrupt, so read until stable.
+      uint16_t overflows;
+      do overflows = _overflows; while (overflows != _overflows);
+      return overflows;
+    }
+    void print(Print * stream, const FSH * name) {
+      StringFormatter::send(stream, F("%S queue size=%d used=%d high=%d overflows=%d\n"),
+        name, SIZE, count(), getHighWater(), getOverflows());
+    }
+
+  private:
+    T _buffer[SIZE];
+    volatile uint8_t _head;
+    volatile uint8_t _tail;
+    volatile uint8_t _highWater;
+    volatile uint16_t _overflows;
+};
+#endif
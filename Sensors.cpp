@@ -75,7 +75,12 @@ decide to ignore the <q ID> return and only react to <Q ID> triggers.
 #include "EEStore.h"
 #endif
 #include "IODevice.h"
+#include "ObjectPool.h"
 
+// Sensors are allocated from a pool so that <S> deletes and recreates
+// reuse the same memory rather than fragmenting the heap.
+static const char sensorPoolName[] FLASH = "Sensor";
+static ObjectPool sensorPool((const FSH *)sensorPoolName, sizeof(Sensor), 8);
 
 ///////////////////////////////////////////////////////////////////////////////
 // checks a number of defined sensors per entry and prints _changed_ sensor state
@@ -199,18 +204,9 @@ Sensor *Sensor::create(int snum, VPIN pin, int pullUp){
 
   remove(snum);  // Unlink and free any existing sensor with the same id, before creating the new one.
 
-  tt = (Sensor *)calloc(1,sizeof(Sensor));
+  tt = (Sensor *)sensorPool.allocate();
   if (!tt) return tt;     // memory allocation failure
 
-  if (pin == VPIN_NONE) 
-    tt->pollingRequired = false;
-  #ifdef USE_NOTIFY
-  else if (IODevice::hasCallback(pin)) 
-    tt->pollingRequired = false;
-  #endif
-  else 
-    tt->pollingRequired = true;
-
   // Add to the start of the list
   tt->nextSensor = firstSensor;
   firstSensor = tt;
@@ -222,12 +218,28 @@ Sensor *Sensor::create(int snum, VPIN pin, int pullUp){
   tt->inputState = 0;
   tt->latchDelay = minReadCount;
 
+  tt->configurePin();
+  return tt;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Object method to set up the sensor's input pin on its HAL device.
+
+void Sensor::configurePin() {
+  VPIN pin = data.pin;
+  if (pin == VPIN_NONE) 
+    pollingRequired = false;
+  #ifdef USE_NOTIFY
+  else if (IODevice::hasCallback(pin)) 
+    pollingRequired = false;
+  #endif
+  else 
+    pollingRequired = true;
+
   if (pin != VPIN_NONE) 
-    IODevice::configureInput(pin, pullUp);   
+    IODevice::configureInput(pin, data.pullUp);   
     // Generally, internal pull-up resistors are not, on their own, sufficient 
     // for external infrared sensors --- each sensor must have its own 1K external pull-up resistor
-
-  return tt;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -272,23 +284,40 @@ bool Sensor::remove(int n){
   // make the following one the next one to be read.
   if (readingSensor==tt) readingSensor=tt->nextSensor;
 
-  free(tt);
+  sensorPool.release(tt);
 
   return true;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 #ifndef DISABLE_EEPROM
+// Sensors are loaded in stored order onto the end of the list.  The stored
+// ids are unique, so there is no need to look for existing sensors as 
+// create() does, and the input pins are configured once all are loaded.
 void Sensor::load(){
-  struct SensorData data;
-  Sensor *tt;
+  Sensor *last=NULL;
+  for (Sensor *tt=firstSensor; tt!=NULL; tt=tt->nextSensor) last=tt;
+  Sensor *firstLoaded=NULL;
 
   uint16_t i=EEStore::eeStore->data.nSensors;
   while(i--){
-    EEPROM.get(EEStore::pointer(),data);
-    tt=create(data.snum, data.pin, data.pullUp);
+    Sensor *tt=(Sensor *)sensorPool.allocate();
+    if (!tt) {
+      // Memory allocation failure, so skip this record and the rest.
+      EEStore::advance((i+1)*sizeof(SensorData));
+      EEStore::loadIncomplete=true;
+      break;
+    }
+    EEPROM.get(EEStore::pointer(),tt->data);
     EEStore::advance(sizeof(tt->data));
+    tt->latchDelay = minReadCount;
+    if (last) last->nextSensor=tt;
+    else firstSensor=tt;
+    last=tt;
+    if (!firstLoaded) firstLoaded=tt;
   }
+  for (Sensor *tt=firstLoaded; tt!=NULL; tt=tt->nextSensor) 
+    tt->configurePin();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -71,6 +71,7 @@ public:
   Sensor *nextSensor;
 
   void setState(int state);
+  void configurePin();
 #ifndef DISABLE_EEPROM
   static void load();
   static void store();
@@ -21,6 +21,7 @@
 
 #include "SerialManager.h"
 #include "DCCEXParser.h"
+#include "StringFormatter.h"
 SerialManager * SerialManager::first=NULL;
 
 SerialManager::SerialManager(Stream * myserial) {
@@ -29,6 +30,18 @@ SerialManager::SerialManager(Stream * myserial) {
   first=this;
   bufferLength=0;
   inCommandPayload=false; 
+  commandTooLong=false;
+  rxOverflows=0;
+  rxBadCommands=0;
+#if SERIAL_TX_QUEUE_SIZE > 0
+  txStart=0;
+  txEnd=0;
+  maxAvailable=0;
+  txHighWater=0;
+  txBlocked=0;
+  txDropped=0;
+  txCoalesced=0;
+#endif
 } 
 
 void SerialManager::init() {
@@ -49,22 +62,185 @@ void SerialManager::init() {
 #endif
 }
 
+// Receives the broadcast text from RingStream::printBuffer in one write
+// and passes it to each port.
+struct SerialManager::Broadcast : public Print {
+  size_t write(uint8_t b) {
+    return write(&b,1);
+  }
+  size_t write(const uint8_t * text, size_t length) {
+    for (SerialManager * s=first;s;s=s->next) s->broadcast2(text,length);
+    return length;
+  }
+};
+
 void SerialManager::broadcast(RingStream * ring) {
-    for (SerialManager * s=first;s;s=s->next) s->broadcast2(ring);
+    Broadcast broadcast;
+    ring->printBuffer(&broadcast);
 }
-void SerialManager::broadcast2(RingStream * ring) {
-    ring->printBuffer(serial);
+
+void SerialManager::broadcast2(const byte * text, size_t length) {
+#if SERIAL_TX_QUEUE_SIZE == 0
+    serial->write(text,length);
+#else
+    // queue line by line, so that whole lines can be dropped or replaced
+    while (length) {
+      const byte * newline=(const byte *)memchr(text,'\n',length);
+      uint16_t lineLength=newline ? newline-text+1 : length;
+      queueLine(text,lineLength);
+      text+=lineLength;
+      length-=lineLength;
+    }
+#endif
+}
+
+#if SERIAL_TX_QUEUE_SIZE > 0
+void SerialManager::queueLine(const byte * line, uint16_t length) {
+    drain();
+    int available=serial->availableForWrite();
+    if (available>maxAvailable) maxAvailable=available;
+    if (txStart==txEnd && (int)length<=available) {
+      // nothing waiting and the UART has room
+      serial->write(line,length);
+      return;
+    }
+    txBlocked+=length;
+    if (length>SERIAL_TX_QUEUE_SIZE) {
+      // Can never fit, so wait for the port as before.
+      while (txStart!=txEnd) {
+        uint16_t oldLength=lineLength(txStart);
+        serial->write(txBuffer+txStart,oldLength);
+        txStart+=oldLength;
+      }
+      txStart=txEnd=0;
+      serial->write(line,length);
+      return;
+    }
+#ifndef SERIAL_TX_NO_COALESCE
+    if (txEnd-txStart+length>SERIAL_TX_QUEUE_SIZE) coalesce(line,length);
+#endif
+    while (txEnd-txStart+length>SERIAL_TX_QUEUE_SIZE) {
+      // drop the oldest line
+      uint16_t oldLength=lineLength(txStart);
+      txStart+=oldLength;
+      txDropped+=oldLength;
+    }
+    if (txEnd+length>SERIAL_TX_QUEUE_SIZE) {
+      // move the queue down to make room at the end
+      memmove(txBuffer,txBuffer+txStart,txEnd-txStart);
+      txEnd-=txStart;
+      txStart=0;
+    }
+    memcpy(txBuffer+txEnd,line,length);
+    txEnd+=length;
+    if (txEnd-txStart>txHighWater) txHighWater=txEnd-txStart;
+}
+
+// Write the queued lines that fit in the UART buffer.  A line longer than
+// the UART buffer is written when the UART is idle, as the wait can't
+// be avoided.  Lines are written whole so that replies and diagnostics
+// written straight to the port can't land in the middle of one.
+void SerialManager::drain() {
+    while (txStart!=txEnd) {
+      int available=serial->availableForWrite();
+      if (available>maxAvailable) maxAvailable=available;
+      uint16_t length=lineLength(txStart);
+      if ((int)length>available && available<maxAvailable) return;
+      serial->write(txBuffer+txStart,length);
+      txStart+=length;
+    }
+    txStart=txEnd=0;
+}
+
+uint16_t SerialManager::lineLength(uint16_t start) {
+    const byte * newline=(const byte *)memchr(txBuffer+start,'\n',txEnd-start);
+    return newline ? newline-(txBuffer+start)+1 : txEnd-start;
 }
 
+void SerialManager::removeLine(uint16_t start, uint16_t length) {
+    memmove(txBuffer+start,txBuffer+start+length,txEnd-start-length);
+    txEnd-=length;
+}
+
+#ifndef SERIAL_TX_NO_COALESCE
+// Remove queued state reports that line supersedes: <l cab ...>, <H id ...>,
+// <Q id> or <q id> for the same cab, turnout or sensor, and <p...>.
+void SerialManager::coalesce(const byte * line, uint16_t length) {
+    if (length<3 || line[0]!='<') return;
+    byte opcode=line[1];
+    if (opcode=='q') opcode='Q';
+    if (opcode!='l' && opcode!='H' && opcode!='Q' && opcode!='p') return;
+    // key is "<X" for power, or "<X id" followed by space or >
+    uint16_t keyLength=2;
+    if (opcode!='p') {
+      keyLength=3;
+      while (keyLength<length && line[keyLength]!=' ' && line[keyLength]!='>') keyLength++;
+    }
+    uint16_t start=txStart;
+    while (start<txEnd) {
+      uint16_t oldLength=lineLength(start);
+      byte * old=txBuffer+start;
+      byte oldOpcode=(oldLength>1 && old[1]=='q') ? 'Q' : old[1];
+      if (oldLength>keyLength && old[0]=='<' && oldOpcode==opcode
+          && memcmp(old+2,line+2,keyLength-2)==0
+          && (opcode=='p' || old[keyLength]==' ' || old[keyLength]=='>')) {
+        removeLine(start,oldLength);
+        txCoalesced++;
+        continue;
+      }
+      start+=oldLength;
+    }
+}
+#endif
+#endif
+
 void SerialManager::loop() {
-    for (SerialManager * s=first;s;s=s->next) s->loop2();
+    for (SerialManager * s=first;s;s=s->next) {
+#if SERIAL_TX_QUEUE_SIZE > 0
+      s->drain();
+#endif
+      s->loop2();
+    }
+}
+
+// <D QUEUES> Show transmit queue usage and receive losses for each port
+void SerialManager::printQueues(Print * stream) {
+    byte port=0;
+    for (SerialManager * s=first;s;s=s->next,port++) {
+#if SERIAL_TX_QUEUE_SIZE > 0
+      StringFormatter::send(stream,F("Serial %d queue size=%d used=%d high=%d blocked=%l dropped=%l coalesced=%d\n"),
+        port, SERIAL_TX_QUEUE_SIZE, s->txEnd-s->txStart, s->txHighWater,
+        s->txBlocked, s->txDropped, s->txCoalesced);
+#else
+      StringFormatter::send(stream,F("Serial %d queue off\n"),port);
+#endif
+#ifdef SERIAL_RX_BUFFER_SIZE
+      StringFormatter::send(stream,F("Serial %d receive buffer=%d overflows=%d bad commands=%d\n"),
+        port, SERIAL_RX_BUFFER_SIZE, s->rxOverflows, s->rxBadCommands);
+#else
+      // Only the AVR cores say how big their receive buffer is.
+      StringFormatter::send(stream,F("Serial %d receive overflows=unknown bad commands=%d\n"),
+        port, s->rxBadCommands);
+#endif
+    }
 }
 
 void SerialManager::loop2() {
+#ifdef SERIAL_RX_BUFFER_SIZE
+    // The core's receive interrupt drops anything arriving while its buffer
+    // is full, so a full buffer here means input has probably been lost.
+    // (SERIAL_RX_BUFFER_SIZE may be raised in the build flags.)  Other cores
+    // don't say how big their buffer is, so overflows aren't counted there.
+    if (serial->available() >= SERIAL_RX_BUFFER_SIZE-1) rxOverflows++;
+#endif
+    unsigned long startTime=micros();
+    byte commands=0;
     while (serial->available()) {
         char ch = serial->read();
         if (ch == '<') {
+            if (inCommandPayload) rxBadCommands++;  // previous command never ended
             inCommandPayload = true;
+            commandTooLong = false;
             bufferLength = 0;
             buffer[0] = '\0';
         }
@@ -72,10 +248,16 @@ void SerialManager::loop2() {
             buffer[bufferLength] = '\0';
             DCCEXParser::parse(serial, buffer, NULL); 
             inCommandPayload = false;
-            break;
+            // Carry on with any further commands already received, within budget
+            if (++commands >= SERIAL_COMMAND_BUDGET) break;
+            if (micros()-startTime > SERIAL_LOOP_BUDGET) break;
         }
         else if (inCommandPayload) {
             if (bufferLength <  (COMMAND_BUFFER_SIZE-1)) buffer[bufferLength++] = ch;
+            else if (!commandTooLong) {
+              commandTooLong = true;
+              rxBadCommands++;
+            }
         }
     }
     
@@ -29,21 +29,68 @@
  #define COMMAND_BUFFER_SIZE 100
 #endif
 
+// Commands parsed per port in one loop() call, and the time allowed for them,
+// so that a burst (e.g. JMRI starting up) is cleared quickly without
+// holding up everything else.
+#ifndef SERIAL_COMMAND_BUDGET
+ #define SERIAL_COMMAND_BUDGET 8
+#endif
+#ifndef SERIAL_LOOP_BUDGET
+ #define SERIAL_LOOP_BUDGET 2000  // microseconds of command parsing per port per loop() call
+#endif
+
+// Broadcast output waiting for room in each port's UART buffer.  0 turns the
+// queue off, which is the default on the small RAM boards (Uno, Nano), and
+// broadcasts are then written straight to the port, waiting for it if busy.
+#ifndef SERIAL_TX_QUEUE_SIZE
+ #if defined(BIG_RAM)
+  #define SERIAL_TX_QUEUE_SIZE 128
+ #else
+  #define SERIAL_TX_QUEUE_SIZE 0
+ #endif
+#endif
+
 class SerialManager {
 public:
   static void init();
   static void loop();
   static void broadcast(RingStream * ring);
+  static void printQueues(Print * stream);
   
 private:  
   static SerialManager * first;
+  struct Broadcast;
   SerialManager(Stream * myserial);
   void loop2();
-  void broadcast2(RingStream * ring);
+  void broadcast2(const byte * text, size_t length);
+#if SERIAL_TX_QUEUE_SIZE > 0
+  void queueLine(const byte * line, uint16_t length);
+  void drain();
+  uint16_t lineLength(uint16_t start);
+  void removeLine(uint16_t start, uint16_t length);
+  void coalesce(const byte * line, uint16_t length);
+#endif
   Stream * serial;
   SerialManager * next;
   byte bufferLength;
   byte buffer[COMMAND_BUFFER_SIZE]; 
   bool inCommandPayload;
+  bool commandTooLong;
+  uint16_t rxOverflows;       // times the UART receive buffer was found full
+  uint16_t rxBadCommands;     // commands cut short or too long for buffer
+
+#if SERIAL_TX_QUEUE_SIZE > 0
+  // Transmit queue of whole lines from txStart to txEnd.  Lines are only
+  // written when they fit in the UART buffer (which the UART interrupt
+  // empties) so broadcasts never wait for the port.
+  byte txBuffer[SERIAL_TX_QUEUE_SIZE];
+  uint16_t txStart;
+  uint16_t txEnd;
+  int maxAvailable;           // availableForWrite() with the UART idle
+  uint16_t txHighWater;
+  unsigned long txBlocked;    // bytes queued because the UART was busy
+  unsigned long txDropped;    // bytes of old lines dropped when full
+  uint16_t txCoalesced;       // lines replaced by a newer report
+#endif
 };
 #endif
@@ -77,11 +77,26 @@ void StringFormatter::send2(Print * stream,const FSH* format, va_list args) {
     
   // thanks to Jan Turoň  https://arduino.stackexchange.com/questions/56517/formatting-strings-in-arduino-for-output
 
+  // Literal text is collected into run and written in blocks, rather than
+  // a virtual write per character.
+  char run[FORMAT_RUN];
+  byte runLength=0;
   char* flash=(char*)format;
   for(int i=0; ; ++i) {
     char c=GETFLASH(flash+i);
+    if (c!='%' && c!='\0') {
+      run[runLength++]=c;
+      if (runLength==FORMAT_RUN) {
+        stream->write((uint8_t*)run,runLength);
+        runLength=0;
+      }
+      continue;
+    }
+    if (runLength) {
+      stream->write((uint8_t*)run,runLength);
+      runLength=0;
+    }
     if (c=='\0') return;
-    if(c!='%') { stream->print(c); continue; }
 
     bool formatContinues=false;
     byte formatWidth=0;
@@ -97,7 +112,7 @@ void StringFormatter::send2(Print * stream,const FSH* format, va_list args) {
       case 's': stream->print(va_arg(args, char*)); break;
       case 'e': printEscapes(stream,va_arg(args, char*)); break;
       case 'E': printEscapes(stream,(const FSH*)va_arg(args, char*)); break;
-      case 'S': stream->print((const FSH*)va_arg(args, char*)); break;
+      case 'S': printFlash(stream,(const FSH*)va_arg(args, char*)); break;
       case 'd': printPadded(stream,va_arg(args, int), formatWidth, formatLeft); break;
       case 'u': printPadded(stream,va_arg(args, unsigned int), formatWidth, formatLeft); break;
       case 'l': printPadded(stream,va_arg(args, long), formatWidth, formatLeft); break;
@@ -166,25 +181,52 @@ void StringFormatter::printEscape(Print * stream, char c) {
  }
 
  
-void StringFormatter::printPadded(Print* stream, long value, byte width, bool formatLeft) {
-  if (width==0) {
-    stream->print(value, DEC);
-    return;
-  }
-  
-    int digits=(value <= 0)? 1: 0;  // zero and negative need extra digot
-    long v=value;
-    while (v) {
-        v /= 10;
-        digits++;
-    }
-    
-    if (formatLeft) stream->print(value, DEC);
-    while(digits<width) {
-      stream->print(' ');
-      digits++;
+// Copy a flash string to stream in blocks, as for the literal text in send2.
+void StringFormatter::printFlash(Print * stream, const FSH * input) {
+  char run[FORMAT_RUN];
+  char* flash=(char*)input;
+  for (;;) {
+    byte runLength=0;
+    while (runLength<FORMAT_RUN) {
+      char c=GETFLASH(flash++);
+      if (c=='\0') break;
+      run[runLength++]=c;
     }
-    if (!formatLeft) stream->print(value, DEC);    
+    if (runLength) stream->write((uint8_t*)run,runLength);
+    if (runLength<FORMAT_RUN) return;
+  }
+}
+
+// Render value into the end of buffer, returns the first character.
+// Divisions are done in 16 bits once the value fits, as 32 bit division
+// is slow on AVR.
+static char * formatDecimal(char * end, long value) {
+  unsigned long v = (value < 0) ? -(unsigned long)value : value;
+  while (v > 0xFFFF) {
+    *--end = '0' + (v % 10);
+    v /= 10;
+  }
+  uint16_t v16 = v;
+  do {
+    *--end = '0' + (v16 % 10);
+    v16 /= 10;
+  } while (v16);
+  if (value < 0) *--end = '-';
+  return end;
+}
+
+void StringFormatter::printPadded(Print* stream, long value, byte width, bool formatLeft) {
+  char buffer[12];  // "-2147483648"
+  char * end = buffer + sizeof(buffer);
+  char * start = formatDecimal(end, value);
+  byte digits = end - start;
+
+  if (formatLeft) stream->write((uint8_t*)start, digits);
+  while(digits<width) {
+    stream->write(' ');
+    digits++;
   }
+  if (!formatLeft) stream->write((uint8_t*)start, end - start);
+}
 
  
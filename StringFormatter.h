@@ -54,9 +54,13 @@ class StringFormatter
     static void printEscapes(char * input);
     static void printEscape( char c);
 
+    // Used by send, and by SEND_FORMAT (CompiledFormat.h)
+    static void printPadded(Print* stream, long value, byte width, bool formatLeft);
+    static void printFlash(Print * stream, const FSH * input);
+
     private: 
     static void send2(Print * serial, const FSH* input,va_list args);
-    static void printPadded(Print* stream, long value, byte width, bool formatLeft);
+    static const byte FORMAT_RUN=16;  // bytes of flash text copied per write
 
 };
 #endif
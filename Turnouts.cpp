@@ -34,6 +34,7 @@
 #include "Turnouts.h"
 #include "DCC.h"
 #include "LCN.h"
+#include "ObjectPool.h"
 #ifdef EESTOREDEBUG
 #include "DIAG.h"
 #endif
@@ -43,34 +44,108 @@
    */ 
 
   /* static */ Turnout *Turnout::_firstTurnout = 0;
+  /* static */ Turnout *Turnout::_lastTurnout = 0;
+  /* static */ Turnout **Turnout::_index = 0;
+  /* static */ uint16_t Turnout::_indexCount = 0;
+  /* static */ uint16_t Turnout::_indexSize = 0;
+  /* static */ bool Turnout::_indexFailed = false;
 
   /* 
    * Public static data
    */
   /* static */ int Turnout::turnoutlistHash = 0;
+
+  /*
+   * Object pool, with slots big enough for any of the turnout types so
+   * that a deleted turnout's slot can be reused by another of any type.
+   */
+  static constexpr size_t maxSize(size_t a, size_t b) { return a > b ? a : b; }
+  static const char turnoutPoolName[] FLASH = "Turnout";
+  static ObjectPool turnoutPool((const FSH *)turnoutPoolName,
+    maxSize(maxSize(sizeof(ServoTurnout), sizeof(DCCTurnout)),
+            maxSize(sizeof(VpinTurnout), sizeof(LCNTurnout))), 8);
+
+  /* static */ void *Turnout::operator new(size_t size) {
+    return turnoutPool.allocate(size);
+  }
+
+  /* static */ void Turnout::operator delete(void *object) {
+    turnoutPool.release(object);
+  }
  
   /*
    * Protected static functions
    */
 
   /* static */ Turnout *Turnout::get(uint16_t id) {
-    // Find turnout object from list.
-    for (Turnout *tt = _firstTurnout; tt != NULL; tt = tt->_nextTurnout)
-      if (tt->_turnoutData.id == id) return tt;
+    if (_indexFailed) {
+      // Find turnout object from list.
+      for (Turnout *tt = _firstTurnout; tt != NULL; tt = tt->_nextTurnout)
+        if (tt->_turnoutData.id == id) return tt;
+      return NULL;
+    }
+    // Find turnout object from index.
+    uint16_t pos = indexPosition(id);
+    if (pos < _indexCount && _index[pos]->_turnoutData.id == id) return _index[pos];
     return NULL;
   }
 
+  // Binary search of index for first entry with id not less than the one given.
+  /* static */ uint16_t Turnout::indexPosition(uint16_t id) {
+    uint16_t low = 0, high = _indexCount;
+    while (low < high) {
+      uint16_t mid = (low + high) / 2;
+      if (_index[mid]->_turnoutData.id < id) 
+        low = mid + 1;
+      else
+        high = mid;
+    }
+    return low;
+  }
+
+  /* static */ void Turnout::addToIndex(Turnout *tt) {
+    if (_indexFailed) return;
+    if (_indexCount == _indexSize) {
+      Turnout **newIndex = (Turnout **)realloc(_index, (_indexSize + INDEX_GROW) * sizeof(Turnout *));
+      if (!newIndex) {
+        // Out of memory, carry on using the list.
+        free(_index);
+        _index = NULL;
+        _indexCount = _indexSize = 0;
+        _indexFailed = true;
+        return;
+      }
+      _index = newIndex;
+      _indexSize += INDEX_GROW;
+    }
+    // Turnouts are usually created in id order, so check the end first.
+    uint16_t id = tt->_turnoutData.id;
+    uint16_t pos = _indexCount;
+    if (pos > 0 && _index[pos-1]->_turnoutData.id > id) {
+      pos = indexPosition(id);
+      memmove(&_index[pos+1], &_index[pos], (_indexCount - pos) * sizeof(Turnout *));
+    }
+    _index[pos] = tt;
+    _indexCount++;
+  }
+
+  /* static */ void Turnout::removeFromIndex(Turnout *tt) {
+    if (_indexFailed) return;
+    uint16_t pos = indexPosition(tt->_turnoutData.id);
+    if (pos < _indexCount && _index[pos] == tt) {
+      _indexCount--;
+      memmove(&_index[pos], &_index[pos+1], (_indexCount - pos) * sizeof(Turnout *));
+    }
+  }
+
   // Add new turnout to end of chain
   /* static */ void Turnout::add(Turnout *tt) {
     if (!_firstTurnout) 
       _firstTurnout = tt;
-    else {
-      // Find last object on chain
-      Turnout *ptr = _firstTurnout;
-      for ( ; ptr->_nextTurnout!=0; ptr=ptr->_nextTurnout) {}
-      // Line new object to last object.
-      ptr->_nextTurnout = tt;
-    }
+    else
+      _lastTurnout->_nextTurnout = tt;
+    _lastTurnout = tt;
+    addToIndex(tt);
     turnoutlistHash++;
   }
   
@@ -87,6 +162,9 @@
       _firstTurnout = tt->_nextTurnout;
     else
       pp->_nextTurnout = tt->_nextTurnout;
+    if (tt == _lastTurnout)
+      _lastTurnout = pp;
+    removeFromIndex(tt);
 
     delete (ServoTurnout *)tt;
 
@@ -144,7 +222,7 @@
       // Write byte containing new closed/thrown state to EEPROM if required.  Note that eepromAddress
       // is always zero for LCN turnouts.
       if (EEStore::eeStore->data.nTurnouts > 0 && tt->_eepromAddress > 0) 
-        EEPROM.put(tt->_eepromAddress, tt->_turnoutData.flags);
+        EEStore::putState(tt->_eepromAddress, tt->_turnoutData.flags);
 #endif
 
     #if defined(EXRAIL_ACTIVE)
@@ -161,7 +239,7 @@
   // Load all turnout objects
   /* static */ void Turnout::load() {
     for (uint16_t i=0; i<EEStore::eeStore->data.nTurnouts; i++) {
-      Turnout::loadTurnout();
+      if (!Turnout::loadTurnout()) EEStore::loadIncomplete = true;
     }
   }
 
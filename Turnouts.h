@@ -93,8 +93,17 @@ protected:
    */ 
 
   static Turnout *_firstTurnout;
+  static Turnout *_lastTurnout;
   static int _turnoutlistHash;
 
+  // Index of turnouts sorted by id, for get().  If it can't be 
+  // allocated, get() falls back to searching the list.
+  static Turnout **_index;
+  static uint16_t _indexCount;
+  static uint16_t _indexSize;
+  static bool _indexFailed;
+  static const uint8_t INDEX_GROW = 8;
+
   /* 
    * Virtual functions
    */
@@ -108,6 +117,9 @@ protected:
 
 
   static void add(Turnout *tt);
+  static uint16_t indexPosition(uint16_t id);
+  static void addToIndex(Turnout *tt);
+  static void removeFromIndex(Turnout *tt);
   
 public:
   static Turnout *get(uint16_t id);
@@ -135,6 +147,9 @@ public:
     (void)stream;  // avoid compiler warnings.
   }
   virtual ~Turnout() {}   // Destructor
+  // All turnout types are allocated from one pool sized for the largest.
+  static void *operator new(size_t size);
+  static void operator delete(void *object);
 
   /*
    * Public static functions
@@ -49,18 +49,26 @@
 #include "DCC.h"
 #include "DCCWaveform.h"
 #include "StringFormatter.h"
+#include "CompiledFormat.h"
 #include "Turnouts.h"
 #include "DIAG.h"
 #include "GITHUB_SHA.h"
 #include "version.h"
 #include "EXRAIL2.h"
 #include "CommandDistributor.h"
+#include "ObjectPool.h"
 
 #define LOOPLOCOS(THROTTLECHAR, CAB)  for (int loco=0;loco<MAX_MY_LOCO;loco++) \
       if ((myLocos[loco].throttle==THROTTLECHAR || '*'==THROTTLECHAR) && (CAB<0 || myLocos[loco].cab==CAB))
 
 WiThrottle * WiThrottle::firstThrottle=NULL;
 
+// Throttles are created and deleted as clients connect and time out.
+static const char throttlePoolName[] FLASH = "WiThrottle";
+static ObjectPool throttlePool((const FSH *)throttlePoolName, sizeof(WiThrottle), 2);
+void * WiThrottle::operator new(size_t size) { return throttlePool.allocate(size); }
+void WiThrottle::operator delete(void * object) { throttlePool.release(object); }
+
 WiThrottle* WiThrottle::getThrottle( int wifiClient) {
   for (WiThrottle* wt=firstThrottle; wt!=NULL ; wt=wt->nextThrottle)  
      if (wt->clientid==wifiClient) return wt; 
@@ -90,6 +98,9 @@ WiThrottle::WiThrottle( int wificlientid) {
    heartBeatEnable=false; // until client turns it on
    turnoutListHash = -1;  // make sure turnout list is sent once
    exRailSent=false;
+   listState=LIST_NONE;
+   broadcastSkipped=false;
+   pendingLocos=0;
    mostRecentCab=0;                
    for (int loco=0;loco<MAX_MY_LOCO; loco++) myLocos[loco].throttle='\0';
 }
@@ -114,48 +125,9 @@ void WiThrottle::parse(RingStream * stream, byte * cmdx) {
   heartBeat=millis();
   if (Diag::WITHROTTLE) DIAG(F("%l WiThrottle(%d)<-[%e]"),millis(),clientid,cmd);
 
-  if (initSent) {
-    // Send turnout list if changed since last sent (will replace list on client)
-    if (turnoutListHash != Turnout::turnoutlistHash) {
-      StringFormatter::send(stream,F("PTL"));
-      for(Turnout *tt=Turnout::first();tt!=NULL;tt=tt->next()){
-          if (tt->isHidden()) continue;
-          int id=tt->getId();
-          const FSH * tdesc=NULL;
-          #ifdef EXRAIL_ACTIVE
-          tdesc=RMFT2::getTurnoutDescription(id);
-          #endif
-          char tchar=Turnout::isClosed(id)?'2':'4';
-          if (tdesc==NULL) // turnout with no description
-              StringFormatter::send(stream,F("]\\[%d}|{T%d}|{T%c"), id,id,tchar);
-	        else 
-              StringFormatter::send(stream,F("]\\[%d}|{%S}|{%c"), id,tdesc,tchar);
-      }
-      StringFormatter::send(stream,F("\n"));
-      turnoutListHash = Turnout::turnoutlistHash; // keep a copy of hash for later comparison
-    }
-
-    else if (!exRailSent) {
-      // Send EX-RAIL routes list if not already sent (but not at same time as turnouts above)
-      exRailSent=true;
-#ifdef EXRAIL_ACTIVE
-   StringFormatter::send(stream,F("PRT]\\[Routes}|{Route]\\[Set}|{2]\\[Handoff}|{4\nPRL"));
-   for (byte pass=0;pass<2;pass++) {
-      // first pass automations, second pass routes.
-    for (int ix=0;;ix++) {
-        int16_t id=GETFLASHW((pass?RMFT2::automationIdList:RMFT2::routeIdList)+ix);
-        if (id==0) break;
-        const FSH * desc=RMFT2::getRouteDescription(id);
-        StringFormatter::send(stream,F("]\\[%c%d}|{%S}|{%c"),
-                      pass?'A':'R',id,desc, pass?'4':'2');
-    }
-   }
-   StringFormatter::send(stream,F("\n"));
-#endif
-      // allow heartbeat to slow down once all metadata sent     
-      StringFormatter::send(stream,F("*%d\n"),HEARTBEAT_SECONDS);
-    }
-  }
+  // Anything sent now would land in the middle of a partly sent list, 
+  // so end the list here and start it again later.
+  if (listState!=LIST_NONE) abortList(stream);
   
   while (cmd[0]) {
     switch (cmd[0]) {
@@ -245,12 +217,139 @@ void WiThrottle::parse(RingStream * stream, byte * cmdx) {
       }
       if (Diag::WITHROTTLE) DIAG(F("%l WiThrottle(%d) Quit"),millis(),clientid);
       delete this; 
-      break;           
+      return;           
     }
     // skip over cmd until 0 or past \r or \n
     while(*cmd !='\0' && *cmd != '\r' && *cmd !='\n') cmd++;
     if (*cmd!='\0') cmd++; // skip \r or \n  
   }           
+
+  // Start sending turnout or route lists if required.
+  sendLists(stream);
+}
+
+/* 
+ * Turnout and route lists are sent a chunk at a time, as space in the 
+ * outbound ring allows, so that a long list doesn't overflow the ring.
+ * A list is a single line, so while it is being sent nothing else may be
+ * sent to the client.  Loco updates are held back by sendLocoUpdates,
+ * and broadcasts are skipped (see holdBroadcast) and the power state
+ * and turnout list resent afterwards.  If the client sends a command 
+ * part way through, the list is ended there and sent again from the start.
+ * Each list is only sent once unless it changes (turnoutListHash), and is
+ * generated directly from the turnout list and EX-RAIL tables each time,
+ * so nothing is held in memory except the position reached.
+ */
+void WiThrottle::sendLists(RingStream * stream) {
+  if (!initSent) return;
+  if (listState==LIST_NONE) {
+    if (turnoutListHash != Turnout::turnoutlistHash) {
+      // Send turnout list if changed since last sent (will replace list on client)
+      listState=LIST_TURNOUTS;
+      listTurnout=Turnout::first();
+      listHash=Turnout::turnoutlistHash;
+      StringFormatter::send(stream,F("PTL"));
+    }
+    else if (!exRailSent) {
+      // Send EX-RAIL routes list if not already sent (but not at same time as turnouts above)
+#ifdef EXRAIL_ACTIVE
+      listState=LIST_ROUTES;
+      listPass=0;
+      listIndex=0;
+      StringFormatter::send(stream,F("PRT]\\[Routes}|{Route]\\[Set}|{2]\\[Handoff}|{4\nPRL"));
+#else
+      exRailSent=true;
+      // allow heartbeat to slow down once all metadata sent     
+      StringFormatter::send(stream,F("*%d\n"),HEARTBEAT_SECONDS);
+#endif
+    }
+    else return;
+  }
+
+  while (stream->freeSpace() > LIST_RESERVE) {
+    if (listState==LIST_TURNOUTS) {
+      if (listHash != Turnout::turnoutlistHash) {
+        // Turnout list has changed under us, so start again.
+        abortList(stream);
+        return;
+      }
+      Turnout * tt=listTurnout;
+      if (tt==NULL) {
+        StringFormatter::send(stream,F("\n"));
+        turnoutListHash = listHash; // keep a copy of hash for later comparison
+        endList(stream);
+        return;
+      }
+      listTurnout=tt->next();
+      if (tt->isHidden()) continue;
+      int id=tt->getId();
+      const FSH * tdesc=NULL;
+      #ifdef EXRAIL_ACTIVE
+      tdesc=RMFT2::getTurnoutDescription(id);
+      #endif
+      char tchar=tt->isClosed()?'2':'4';
+      if (tdesc==NULL) // turnout with no description
+        StringFormatter::send(stream,F("]\\[%d}|{T%d}|{T%c"), id,id,tchar);
+      else 
+        StringFormatter::send(stream,F("]\\[%d}|{%S}|{%c"), id,tdesc,tchar);
+    }
+#ifdef EXRAIL_ACTIVE
+    else if (listState==LIST_ROUTES) {
+      // first pass routes, second pass automations.
+      int16_t id=GETFLASHW((listPass?RMFT2::automationIdList:RMFT2::routeIdList)+listIndex);
+      if (id==0) {
+        if (listPass==0) {
+          listPass=1;
+          listIndex=0;
+          continue;
+        }
+        StringFormatter::send(stream,F("\n"));
+        exRailSent=true;
+        // allow heartbeat to slow down once all metadata sent     
+        StringFormatter::send(stream,F("*%d\n"),HEARTBEAT_SECONDS);
+        endList(stream);
+        return;
+      }
+      listIndex++;
+      const FSH * desc=RMFT2::getRouteDescription(id);
+      StringFormatter::send(stream,F("]\\[%c%d}|{%S}|{%c"),
+                    listPass?'A':'R',id,desc, listPass?'4':'2');
+    }
+#endif
+    else return;
+  }
+}
+
+// Called at the end of a list.  If any broadcasts were skipped
+// while it was being sent, resend the power state and turnout list.
+void WiThrottle::endList(RingStream * stream) {
+  listState=LIST_NONE;
+  if (broadcastSkipped) {
+    broadcastSkipped=false;
+    StringFormatter::send(stream,F("PPA%x\n"),DCCWaveform::mainTrack.getPowerMode()==POWERMODE::ON);
+    turnoutListHash=-1;
+  }
+}
+
+// End a partly sent list, so that it will be sent again from the start.
+void WiThrottle::abortList(RingStream * stream) {
+  StringFormatter::send(stream,F("\n"));
+  if (listState==LIST_TURNOUTS) turnoutListHash=-1;
+  else exRailSent=false;
+  listState=LIST_NONE;
+}
+
+// Called by CommandDistributor before broadcasting to a client.  Returns true
+// if the broadcast must not be sent because a list is being sent to the client.
+bool WiThrottle::holdBroadcast(int wifiClient) {
+  for (WiThrottle* wt=firstThrottle; wt!=NULL ; wt=wt->nextThrottle) {
+    if (wt->clientid==wifiClient) {
+      if (wt->listState==LIST_NONE) return false;
+      wt->broadcastSkipped=true;
+      return true;
+    }
+  }
+  return false;
 }
 
 int WiThrottle::getInt(byte * cmd) {
@@ -308,7 +407,7 @@ void WiThrottle::multithrottle(RingStream * stream, byte * cmd){
 	myLocos[loco].throttle=throttleChar;
 	myLocos[loco].cab=locoid; 
 	myLocos[loco].functionMap=DCC::getFunctionMap(locoid); 
-	myLocos[loco].broadcastPending=true; // means speed/dir will be sent later
+	markLoco(loco); // means speed/dir will be sent later
 	mostRecentCab=locoid;
 	StringFormatter::send(stream, F("M%c+%c%d<;>\n"), throttleChar, cmd[3] ,locoid); //tell client to add loco
 	int fkeys=29;
@@ -409,7 +508,7 @@ void WiThrottle::locoAction(RingStream * stream, byte* aval, char throttleChar,
     if (aval[1]=='V' || aval[1]=='R' ) {   //qV or qR
       // just flag the loco for broadcast and it will happen.
       LOOPLOCOS(throttleChar, cab) {              
-	myLocos[loco].broadcastPending=true;
+	markLoco(loco);
       }                           
     }     
     break;    
@@ -455,17 +554,51 @@ int WiThrottle::WiTToDCCSpeed(int WiTSpeed) {
   return WiTSpeed + 1; //offset others by 1
 }
 
+/* 
+ * Loco changes are only sent to clients that have been marked by 
+ * markForBroadcast, and only for the locos marked.  Each client keeps
+ * a bit per myLocos entry in pendingLocos, and anyPending saves walking
+ * the clients at all when nothing has changed.  Heartbeat timeouts are
+ * checked for all clients together once every HEARTBEAT_CHECK_MS.
+ */
+bool WiThrottle::anyPending=false;
+unsigned long WiThrottle::lastHeartbeatCheck=0;
+
 void WiThrottle::loop(RingStream * stream) {
-  // for each WiThrottle, check the heartbeat and broadcast needed
-  for (WiThrottle* wt=firstThrottle; wt!=NULL ; wt=wt->nextThrottle) 
-    wt->checkHeartbeat(stream);
-  
+  // check the heartbeats
+  unsigned long now=millis();
+  if (now-lastHeartbeatCheck >= HEARTBEAT_CHECK_MS) {
+    lastHeartbeatCheck=now;
+    WiThrottle* next;
+    for (WiThrottle* wt=firstThrottle; wt!=NULL ; wt=next) {
+      next=wt->nextThrottle;  // checkHeartbeat may delete wt
+      wt->checkHeartbeat(now);
+    }
+  }
+
+  // send any loco changes
+  if (anyPending) {
+    anyPending=false;
+    for (WiThrottle* wt=firstThrottle; wt!=NULL ; wt=wt->nextThrottle) 
+      if (wt->pendingLocos) wt->sendLocoUpdates(stream);
+  }
+
+  // continue sending any lists in progress, or start any that are needed
+  for (WiThrottle* wt=firstThrottle; wt!=NULL ; wt=wt->nextThrottle) {
+    if (!wt->initSent) continue;
+    if (wt->listState==LIST_NONE && wt->exRailSent 
+        && wt->turnoutListHash==Turnout::turnoutlistHash) continue;
+    if (stream->freeSpace() <= LIST_RESERVE) break;
+    stream->mark(wt->clientid);
+    wt->sendLists(stream);
+    stream->commit();
+  }
 
 }
 
-void WiThrottle::checkHeartbeat(RingStream * stream) {
+void WiThrottle::checkHeartbeat(unsigned long now) {
   // if eStop time passed... eStop any locos still assigned to this client and then drop the connection
-  if(heartBeatEnable && (millis()-heartBeat > ESTOP_SECONDS*1000)) {
+  if(heartBeatEnable && (now-heartBeat > ESTOP_SECONDS*1000)) {
     if (Diag::WITHROTTLE)  DIAG(F("%l WiThrottle(%d) eStop(%ds) timeout, drop connection"), millis(), clientid, ESTOP_SECONDS);
     LOOPLOCOS('*', -1) { 
       if (myLocos[loco].throttle!='\0') {
@@ -474,46 +607,51 @@ void WiThrottle::checkHeartbeat(RingStream * stream) {
       }
     }
     delete this;
-    return;
   }
-   
+}
+
+void WiThrottle::sendLocoUpdates(RingStream * stream) {
    // send any outstanding speed/direction/function changes for this clients locos
    // Changes may have been caused by this client, or another non-Withrottle or Exrail
-  bool streamHasBeenMarked=false; 
+   // Hold them back while a list is being sent, or if there is no room for them.
+  if (listState!=LIST_NONE || stream->freeSpace() <= LIST_RESERVE) {
+    anyPending=true;  // try again next loop
+    return;
+  }
+  stream->mark(clientid);
   LOOPLOCOS('*', -1) { 
-    if (myLocos[loco].throttle!='\0' && myLocos[loco].broadcastPending) {
-      if (!streamHasBeenMarked) {
-	stream->mark(clientid);
-	streamHasBeenMarked=true;
-      }
-      myLocos[loco].broadcastPending=false;
-      int cab=myLocos[loco].cab;
-      char lors=LorS(cab);
-      char throttle=myLocos[loco].throttle;
-      StringFormatter::send(stream,F("M%cA%c%d<;>V%d\n"),
-			    throttle, lors , cab, DCCToWiTSpeed(DCC::getThrottleSpeed(cab)));
-      StringFormatter::send(stream,F("M%cA%c%d<;>R%d\n"), 
-			    throttle, lors , cab, DCC::getThrottleDirection(cab));
+    if (!(pendingLocos & (1<<loco))) continue;
+    if (myLocos[loco].throttle=='\0') continue;
+    int cab=myLocos[loco].cab;
+    char lors=LorS(cab);
+    char throttle=myLocos[loco].throttle;
+    
+    // one speed table lookup for speed, direction and functions
+    int reg=DCC::lookupSpeedTable(cab);
+    byte speedCode=(reg<0) ? 0x80 : DCC::speedTable[reg].speedCode;
+    uint32_t dccFunctionMap=(reg<0) ? 0 : DCC::speedTable[reg].functions;
+    SEND_FORMAT(stream,"M%cA%c%d<;>V%d\nM%cA%c%d<;>R%d\n",
+			  throttle, lors , cab, DCCToWiTSpeed(speedCode & 0x7F),
+			  throttle, lors , cab, (speedCode & 0x80)?1:0);
       
-      // compare the DCC functionmap with the local copy and send changes  
-      uint32_t dccFunctionMap=DCC::getFunctionMap(cab);
-      uint32_t myFunctionMap=myLocos[loco].functionMap;
-      myLocos[loco].functionMap=dccFunctionMap;
+    // compare the DCC functionmap with the local copy and send changes  
+    uint32_t myFunctionMap=myLocos[loco].functionMap;
+    myLocos[loco].functionMap=dccFunctionMap;
       
-      // loop the maps sending any bit changed
-      // Loop is terminated as soon as no changes are left
-      for (byte fn=0;dccFunctionMap!=myFunctionMap;fn++) {
-	if ((dccFunctionMap&1) != (myFunctionMap&1)) {
-	  StringFormatter::send(stream,F("M%cA%c%d<;>F%c%d\n"),
-				throttle, lors , cab, (dccFunctionMap&1)?'1':'0',fn);
-	} 
-	// shift just checked bit off end of both maps
-	dccFunctionMap>>=1;
-	myFunctionMap>>=1;
+    // loop the maps sending any bit changed
+    // Loop is terminated as soon as no changes are left
+    for (byte fn=0;dccFunctionMap!=myFunctionMap;fn++) {
+      if ((dccFunctionMap&1) != (myFunctionMap&1)) {
+        SEND_FORMAT(stream,"M%cA%c%d<;>F%c%d\n",
+			      throttle, lors , cab, (dccFunctionMap&1)?'1':'0',fn);
       } 
-    }
-    }
-  if (streamHasBeenMarked)   stream->commit();     
+      // shift just checked bit off end of both maps
+      dccFunctionMap>>=1;
+      myFunctionMap>>=1;
+    } 
+  }
+  pendingLocos=0;
+  stream->commit();     
 }
 
 void WiThrottle::markForBroadcast(int cab) {
@@ -522,10 +660,14 @@ void WiThrottle::markForBroadcast(int cab) {
 }
 void WiThrottle::markForBroadcast2(int cab) {
   LOOPLOCOS('*', cab) { 
-    myLocos[loco].broadcastPending=true;
+    markLoco(loco);
   }
 }
 
+void WiThrottle::markLoco(int loco) {
+  pendingLocos |= (1<<loco);
+  anyPending=true;
+}
 
 char WiThrottle::LorS(int cab) {
   return (cab<=HIGHEST_SHORT_ADDR)?'S':'L';
@@ -540,6 +682,7 @@ char         WiThrottle::stashThrottleChar;
 
 void WiThrottle::getLocoCallback(int16_t locoid) {
   stashStream->mark(stashClient);
+  if (stashInstance->listState!=LIST_NONE) stashInstance->abortList(stashStream);
   
   if (locoid<=0) {
     StringFormatter::send(stashStream,F("HMNo loco found on prog track\n"));
@@ -22,11 +22,11 @@
 #define WiThrottle_h
 
 #include "RingStream.h"
+#include "Turnouts.h"
 
 struct MYLOCO {
     char throttle; //indicates which throttle letter on client, often '0','1' or '2'
     int cab; //address of this loco
-    bool broadcastPending;
     uint32_t functionMap;
     uint32_t functionToggles;
 };
@@ -37,14 +37,21 @@ class WiThrottle {
     void parse(RingStream * stream, byte * cmd);
     static WiThrottle* getThrottle( int wifiClient); 
     static void markForBroadcast(int cab);
+    static bool holdBroadcast(int wifiClient);
       
   private: 
     WiThrottle( int wifiClientId);
     ~WiThrottle();
+    static void *operator new(size_t size);
+    static void operator delete(void *object);
    
-      static const int MAX_MY_LOCO=10;      // maximum number of locos assigned to a single client
+      static const int MAX_MY_LOCO=10;      // maximum number of locos assigned to a single client (max 16, see pendingLocos)
       static const int HEARTBEAT_SECONDS=10; // heartbeat at 4secs to provide messaging transport
       static const int ESTOP_SECONDS=20;     // eStop if no incoming messages for more than 8secs
+      static const int LIST_RESERVE=200;     // outbound ring space left free when sending lists
+      static const int HEARTBEAT_CHECK_MS=1000; // interval between heartbeat timeout checks
+      static bool anyPending;       // some client has pendingLocos set
+      static unsigned long lastHeartbeatCheck;
       static WiThrottle* firstThrottle;
       static int getInt(byte * cmd);
       static int getLocoId(byte * cmd);
@@ -63,13 +70,27 @@ class WiThrottle {
       uint16_t mostRecentCab;
       int turnoutListHash;  // used to check for changes to turnout list
       bool lastPowerState;  // last power state sent to this client
+      // State of turnout/route list being sent to this client, a chunk at a time.
+      enum : byte {LIST_NONE, LIST_TURNOUTS, LIST_ROUTES};
+      byte listState;
+      byte listPass;        // routes list: 0=routes, 1=automations
+      int16_t listIndex;    // routes list: next entry in routes or automations
+      Turnout * listTurnout; // turnout list: next turnout to send
+      int listHash;         // turnoutlistHash when list started
+      bool broadcastSkipped; // broadcast skipped while list being sent
+      uint16_t pendingLocos; // bit per myLocos entry with changes to send
+      void sendLists(RingStream * stream);
+      void endList(RingStream * stream);
+      void abortList(RingStream * stream);
       int DCCToWiTSpeed(int DCCSpeed);
       int WiTToDCCSpeed(int WiTSpeed);
       void multithrottle(RingStream * stream, byte * cmd);
       void locoAction(RingStream * stream, byte* aval, char throttleChar, int cab);
       void accessory(RingStream *, byte* cmd);
-      void checkHeartbeat(RingStream * stream); 
+      void checkHeartbeat(unsigned long now); 
+      void sendLocoUpdates(RingStream * stream);
       void markForBroadcast2(int cab);
+      void markLoco(int loco);
        // callback stuff to support prog track acquire
        static RingStream * stashStream;
        static WiThrottle * stashInstance;
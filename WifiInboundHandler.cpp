@@ -44,6 +44,7 @@ WifiInboundHandler::WifiInboundHandler(Stream * ESStream) {
   inboundRing=new RingStream(INBOUND_RING);
   outboundRing=new RingStream(OUTBOUND_RING);
   pendingCipsend=false;
+  cipsendState=CIPSEND_IDLE;
 } 
 
 
@@ -56,20 +57,20 @@ void WifiInboundHandler::loop1() {
 
    WiThrottle::loop(outboundRing);
    
-    // if nothing is already CIPSEND pending, we can CIPSEND one reply
-    if (clientPendingCIPSEND<0) {
-       clientPendingCIPSEND=outboundRing->read();
-       if (clientPendingCIPSEND>=0) {
-         currentReplySize=outboundRing->count();
-         pendingCipsend=true;
-       }
-     }
+    // Give up waiting for SEND OK if it doesn't come
+    if (cipsendState==CIPSEND_WAIT_OK && millis()-cipsendTime > CIPSEND_TIMEOUT) {
+       if (Diag::WIFI) DIAG(F("Wifi: SEND OK timeout"));
+       cipsendState=CIPSEND_IDLE;
+    }
     
+    // if nothing is already CIPSEND pending, we can CIPSEND the next replies
+    if (cipsendState==CIPSEND_IDLE) prepareCIPSEND();
 
     if (pendingCipsend) {
          if (Diag::WIFI) DIAG( F("WiFi: [[CIPSEND=%d,%d]]"), clientPendingCIPSEND, currentReplySize);
          StringFormatter::send(wifiStream, F("AT+CIPSEND=%d,%d\r\n"),  clientPendingCIPSEND, currentReplySize);
          pendingCipsend=false;
+         cipsendState=CIPSEND_WAIT_PROMPT;
          return;
       }
     
@@ -85,7 +86,7 @@ void WifiInboundHandler::loop1() {
          if (Diag::WIFI) DIAG(F("%e"),cmd); 
          
          outboundRing->mark(clientId);  // remember start of outbound data 
-         CommandDistributor::parse(clientId,cmd,outboundRing);
+         CommandDistributor::parse(clientId,cmd,outboundRing,count);
          // The commit call will either write the lenbgth bytes 
          // OR rollback to the mark because the reply is empty or commend generated more than fits the buffer 
          if (!outboundRing->commit()) {
@@ -118,14 +119,23 @@ WifiInboundHandler::INBOUND_STATE WifiInboundHandler::loop2() {
         }
         
         if (ch=='>') { 
-           if (Diag::WIFI) DIAG(F("[XMIT %d]"),currentReplySize); 
-           for (int i=0;i<currentReplySize;i++) {
-             int cout=outboundRing->read();
-             wifiStream->write(cout);
-             if (Diag::WIFI) StringFormatter::printEscape(cout); // DIAG in disguise
+           if (cipsendState!=CIPSEND_WAIT_PROMPT) break; 
+           if (Diag::WIFI) DIAG(F("[XMIT %d/%d]"),currentReplySize,currentReplyFrames); 
+           for (int frame=0;frame<currentReplyFrames;frame++) {
+             outboundRing->read();  // client id
+             int count=outboundRing->count();
+             if (Diag::WIFI) {
+               for (int i=0;i<count;i++) {
+                 int cout=outboundRing->read();
+                 wifiStream->write(cout);
+                 StringFormatter::printEscape(cout); // DIAG in disguise
+               }
+             }
+             else outboundRing->transfer(wifiStream,count);
            }
-           clientPendingCIPSEND=-1;
            pendingCipsend=false;
+           cipsendState=CIPSEND_WAIT_OK;
+           cipsendTime=millis();
            loopState=SKIPTOEND;
            break;
         }
@@ -135,13 +145,13 @@ WifiInboundHandler::INBOUND_STATE WifiInboundHandler::loop2() {
           break;
         }
        
-        if (ch=='S') { // SEND OK probably 
-          loopState=SKIPTOEND;
+        if (ch=='S') { // SEND OK or SEND FAIL probably 
+          loopState=SEND_STATUS;
           break;
         }
         
         if (ch=='b') {   // This is a busy indicator... probabaly must restart a CIPSEND  
-           pendingCipsend=(clientPendingCIPSEND>=0);
+           pendingCipsend=(cipsendState==CIPSEND_WAIT_PROMPT);
            loopState=SKIPTOEND; 
            break; 
         }
@@ -153,10 +163,11 @@ WifiInboundHandler::INBOUND_STATE WifiInboundHandler::loop2() {
         }
 
         if (ch=='E' || ch=='l') { // ERROR or "link is not valid"
-          if (clientPendingCIPSEND>=0) {
+          if (cipsendState==CIPSEND_WAIT_PROMPT) {
             // A CIPSEND was errored... just toss it away
             purgeCurrentCIPSEND(); 
           }
+          else if (cipsendState==CIPSEND_WAIT_OK) cipsendState=CIPSEND_IDLE;
           loopState=SKIPTOEND; 
           break; 
         }
@@ -180,14 +191,18 @@ WifiInboundHandler::INBOUND_STATE WifiInboundHandler::loop2() {
         break;
         
       case IPD4_CLIENT:  // reading connection id
-        if (ch >= '0' || ch <='9'){
+        if (ch >= '0' && ch <='9'){
            runningClientId=ch-'0';
            loopState=IPD5;
         }
         else loopState=SKIPTOEND;
         break;
         
-      case IPD5:  // Looking for ,   After +IPD,client
+      case IPD5:  // Looking for ,   After +IPD,client (client id may be more than one digit)
+        if (ch >= '0' && ch <='9') {
+          runningClientId=runningClientId*10 + (ch-'0');
+          break;
+        }
         loopState = (ch == ',') ? IPD6_LENGTH : SKIPTOEND;
         dataLength=0;  // ready to start collecting the length
         break;
@@ -226,19 +241,32 @@ WifiInboundHandler::INBOUND_STATE WifiInboundHandler::loop2() {
         if (dataLength == 0) loopState = ANYTHING;
         break;
 
-      case GOT_CLIENT_ID:  // got x before CLOSE or CONNECTED
+      case GOT_CLIENT_ID:  // got x before CLOSE or CONNECTED (x may be more than one digit)
+        if (ch>='0' && ch<='9') {
+          runningClientId=runningClientId*10 + (ch-'0');
+          break;
+        }
         loopState=(ch==',') ? GOT_CLIENT_ID2: SKIPTOEND;
         break;
         
       case GOT_CLIENT_ID2:  // got "x,"  
         if (ch=='C') {
          // got "x C" before CLOSE or CONNECTED, or CONNECT FAILED
-         if (runningClientId==clientPendingCIPSEND) purgeCurrentCIPSEND();
+         if (runningClientId==clientPendingCIPSEND && cipsendState==CIPSEND_WAIT_PROMPT) purgeCurrentCIPSEND();
          else CommandDistributor::forget(runningClientId);
         }
         loopState=SKIPTOEND;   
         break;
          
+      case SEND_STATUS: // got S, looking for SEND OK or SEND FAIL
+        if (ch=='O' || ch=='F') {
+          if (ch=='F') DIAG(F("Wifi: SEND FAIL client %d"),clientPendingCIPSEND);
+          if (cipsendState==CIPSEND_WAIT_OK) cipsendState=CIPSEND_IDLE;
+          loopState=SKIPTOEND;
+        }
+        else if (ch=='\n') loopState=ANYTHING;
+        break;
+
       case SKIPTOEND: // skipping for /n
         if (ch=='\n') loopState=ANYTHING;
         break;
@@ -247,13 +275,40 @@ WifiInboundHandler::INBOUND_STATE WifiInboundHandler::loop2() {
   return (loopState==ANYTHING) ? INBOUND_IDLE: INBOUND_BUSY;
 }
 
+// Collect the replies at the front of the outbound ring for the next CIPSEND.
+// Consecutive replies to the same client are sent together, up to CIPSEND_MAX
+// bytes. The replies stay in the ring until the > prompt arrives. 
+void WifiInboundHandler::prepareCIPSEND() {
+  int client=outboundRing->peek(0);
+  if (client<0) return;
+  int size=0;
+  int frames=0;
+  int offset=0;
+  while (outboundRing->peek(offset)==client) {
+    int len=(outboundRing->peek(offset+1)<<8) | outboundRing->peek(offset+2);
+    if (frames>0 && size+len > CIPSEND_MAX) break;
+    size+=len;
+    frames++;
+    offset+=3+len;
+  }
+  clientPendingCIPSEND=client;
+  currentReplySize=size;
+  currentReplyFrames=frames;
+  pendingCipsend=true;
+}
+
 void WifiInboundHandler::purgeCurrentCIPSEND() {
          // A CIPSEND was sent but errored... or the client closed just toss it away
          CommandDistributor::forget(clientPendingCIPSEND); 
          DIAG(F("Wifi: DROPPING CIPSEND=%d,%d"),clientPendingCIPSEND,currentReplySize);
-         for (int i=0;i<currentReplySize;i++) outboundRing->read();
+         for (int frame=0;frame<currentReplyFrames;frame++) {
+           outboundRing->read();  // client id
+           int count=outboundRing->count();
+           for (int i=0;i<count;i++) outboundRing->read();
+         }
          pendingCipsend=false;  
          clientPendingCIPSEND=-1;
+         cipsendState=CIPSEND_IDLE;
 }
 
 #endif
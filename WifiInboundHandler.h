@@ -57,18 +57,28 @@ class WifiInboundHandler {
           IPD_IGNORE_DATA, // got +IPD,c,ll,: ignoring the data that won't fit inblound Ring
 
           GOT_CLIENT_ID,  // clientid prefix to CONNECTED / CLOSED
-          GOT_CLIENT_ID2  // clientid prefix to CONNECTED / CLOSED
+          GOT_CLIENT_ID2,  // clientid prefix to CONNECTED / CLOSED
+          SEND_STATUS     // got S, looking for SEND OK or SEND FAIL
   };
 
+   enum CIPSEND_STATE : byte {
+        CIPSEND_IDLE,        // nothing outstanding, may CIPSEND
+        CIPSEND_WAIT_PROMPT, // sent AT+CIPSEND, waiting for >
+        CIPSEND_WAIT_OK      // sent data, waiting for SEND OK
+   };
+
   
    WifiInboundHandler(Stream * ESStream);
    void loop1();
    INBOUND_STATE loop2();
+   void prepareCIPSEND();
    void purgeCurrentCIPSEND();
    Stream * wifiStream;
    
    static const int INBOUND_RING = 512;
    static const int OUTBOUND_RING = 2048;
+   static const int CIPSEND_MAX = 2048;  // ESP AT limit for one CIPSEND
+   static const unsigned long CIPSEND_TIMEOUT = 2000; // ms to wait for SEND OK
  
    RingStream * inboundRing;
    RingStream * outboundRing;
@@ -78,6 +88,9 @@ class WifiInboundHandler {
   int dataLength; // dataLength of +IPD
   int clientPendingCIPSEND=-1;
   int currentReplySize;
+  int currentReplyFrames; // replies merged into current CIPSEND
   bool pendingCipsend;
+  CIPSEND_STATE cipsendState;
+  unsigned long cipsendTime; // when data was sent, for SEND OK timeout
 };
 #endif
@@ -289,6 +289,9 @@ wifiSerialState WifiInterface::setup2(const FSH* SSid, const FSH* password,
     checkForOK(1000, true);                                                        // dont care if not supported
   }
 
+  StringFormatter::send(wifiStream, F("AT+CIPSERVERMAXCONN=%d\r\n"), MAX_NUM_TCP_CLIENTS); // allow more clients
+  checkForOK(1000, true);                                                        // dont care if firmware limit is lower
+
   StringFormatter::send(wifiStream, F("AT+CIPSERVER=1,%d\r\n"), port); // turn on server on port
   if (!checkForOK(1000, true)) return WIFI_DISCONNECTED;
 #endif //DONT_TOUCH_WIFI_CONF
@@ -104,6 +104,14 @@ The configuration file for DCC-EX Command Station
 //
 //#define ENABLE_ETHERNET true
 
+/////////////////////////////////////////////////////////////////////////////////////
+//
+// BINARY_PROTOCOL: Uncomment to accept the compact binary command frames
+// described in BinaryProtocol.h from WiFi and Ethernet clients, as well
+// as the <...> text commands. 
+//
+//#define BINARY_PROTOCOL
+
 
 /////////////////////////////////////////////////////////////////////////////////////
 //
@@ -143,6 +151,16 @@ The configuration file for DCC-EX Command Station
 // to do that. Of course, then none of the EEPROM related commands work.
 //
 // #define DISABLE_EEPROM
+//
+// Turnout and output states are saved as a log in the top 256 bytes of the
+// EEPROM (or an eighth of it, if that is less), so that each change doesn't
+// wear out the same byte.  It is left unused if the saved definitions reach
+// into it.  Set to 0 to save the states in place.
+//#define EESTORE_LOG_SIZE 0
+//
+// State changes are written in the background, at most this many bytes each
+// time round the main loop, so that the loop never waits for the EEPROM.
+//#define EESTORE_WRITES_PER_LOOP 1
 
 /////////////////////////////////////////////////////////////////////////////////////
 // REDEFINE WHERE SHORT/LONG ADDR break is. According to NMRA the last short address
@@ -195,5 +213,30 @@ The configuration file for DCC-EX Command Station
 //#define SERIAL1_COMMANDS
 //#define SERIAL2_COMMANDS
 //#define SERIAL3_COMMANDS
+//
+// Broadcasts to serial throttles are queued while the port is busy rather
+// than holding up the command station.  When a queue is full, older
+// loco, turnout, sensor and power reports are replaced by the new one for
+// the same loco, turnout or sensor, and failing that the oldest lines are
+// dropped.  Uncomment to only drop the oldest.
+//#define SERIAL_TX_NO_COALESCE
+// Bytes queued per serial port (default 128, but 0, meaning no queue, on the
+// Uno and Nano where RAM is short)
+//#define SERIAL_TX_QUEUE_SIZE 256
+// Commands parsed per serial port in one loop() call (default 8), and
+// microseconds allowed for them (default 2000)
+//#define SERIAL_COMMAND_BUDGET 16
+//#define SERIAL_LOOP_BUDGET 4000
+// Microseconds of Ethernet socket reads and writes in one loop() call
+// (default 2000)
+//#define ETH_LOOP_BUDGET 4000
+// Commands arriving faster than they can be parsed wait in the core's
+// interrupt driven receive buffer (64 bytes on AVR).  If <D QUEUES> shows
+// receive overflows, enlarge it in the build flags, not here, as the core
+// is compiled separately, e.g. in platformio.ini
+//   build_flags = -DSERIAL_RX_BUFFER_SIZE=256
+// Receive overflows are only counted on AVR boards, as other cores don't
+// say how big their buffer is; <D QUEUES> shows them as unknown there.
+// Commands cut short or too long for the command buffer are counted on all.
 
 /////////////////////////////////////////////////////////////////////////////////////
@@ -199,6 +199,8 @@ The configuration file for DCC-EX Command Station
 // topic for publishing sensor data
 #define SENSORTOPIC "/trains/track/sensor/"  
 #define TURNOUTTOPIC "/trains/track/turnout/"  
+// uncomment to publish loco speeds, track power and current for dashboards
+//#define MQTT_TELEMETRY
 //
 
 /////////////////////////////////////////////////////////////////////////////////////
@@ -68,6 +68,12 @@
   #define ETHERNET_ON false
 #endif
 
+// Network clients (WiFi link ids or Ethernet sockets) that CommandDistributor 
+// can keep track of.  The ESP firmware or the Ethernet chip may allow fewer.
+#ifndef MAX_NUM_TCP_CLIENTS
+  #define MAX_NUM_TCP_CLIENTS 20
+#endif
+
 #if WIFI_ON && ETHERNET_ON
  #error Command Station does not support WIFI and ETHERNET at the same time.
 #endif
@@ -9,6 +9,10 @@
 
 myPubSubClient::myPubSubClient() {
     this->_state = MQTT_DISCONNECTED;
+    this->buffer = NULL;
+    this->rxBuffer = NULL;
+    this->bufferSize = 0;
+    setBufferSize(MQTT_MAX_PACKET_SIZE);
     this->_client = NULL;
     this->stream = NULL;
     setCallback(NULL);
@@ -16,24 +20,40 @@ myPubSubClient::myPubSubClient() {
 
 myPubSubClient::myPubSubClient(Client& client) {
     this->_state = MQTT_DISCONNECTED;
+    this->buffer = NULL;
+    this->rxBuffer = NULL;
+    this->bufferSize = 0;
+    setBufferSize(MQTT_MAX_PACKET_SIZE);
     setClient(client);
     this->stream = NULL;
 }
 
 myPubSubClient::myPubSubClient(IPAddress addr, uint16_t port, Client& client) {
     this->_state = MQTT_DISCONNECTED;
+    this->buffer = NULL;
+    this->rxBuffer = NULL;
+    this->bufferSize = 0;
+    setBufferSize(MQTT_MAX_PACKET_SIZE);
     setServer(addr, port);
     setClient(client);
     this->stream = NULL;
 }
 myPubSubClient::myPubSubClient(IPAddress addr, uint16_t port, Client& client, Stream& stream) {
     this->_state = MQTT_DISCONNECTED;
+    this->buffer = NULL;
+    this->rxBuffer = NULL;
+    this->bufferSize = 0;
+    setBufferSize(MQTT_MAX_PACKET_SIZE);
     setServer(addr,port);
     setClient(client);
     setStream(stream);
 }
 myPubSubClient::myPubSubClient(IPAddress addr, uint16_t port, MQTT_CALLBACK_SIGNATURE, Client& client) {
     this->_state = MQTT_DISCONNECTED;
+    this->buffer = NULL;
+    this->rxBuffer = NULL;
+    this->bufferSize = 0;
+    setBufferSize(MQTT_MAX_PACKET_SIZE);
     setServer(addr, port);
     setCallback(callback);
     setClient(client);
@@ -41,6 +61,10 @@ myPubSubClient::myPubSubClient(IPAddress addr, uint16_t port, MQTT_CALLBACK_SIGN
 }
 myPubSubClient::myPubSubClient(IPAddress addr, uint16_t port, MQTT_CALLBACK_SIGNATURE, Client& client, Stream& stream) {
     this->_state = MQTT_DISCONNECTED;
+    this->buffer = NULL;
+    this->rxBuffer = NULL;
+    this->bufferSize = 0;
+    setBufferSize(MQTT_MAX_PACKET_SIZE);
     setServer(addr,port);
     setCallback(callback);
     setClient(client);
@@ -49,18 +73,30 @@ myPubSubClient::myPubSubClient(IPAddress addr, uint16_t port, MQTT_CALLBACK_SIGN
 
 myPubSubClient::myPubSubClient(uint8_t *ip, uint16_t port, Client& client) {
     this->_state = MQTT_DISCONNECTED;
+    this->buffer = NULL;
+    this->rxBuffer = NULL;
+    this->bufferSize = 0;
+    setBufferSize(MQTT_MAX_PACKET_SIZE);
     setServer(ip, port);
     setClient(client);
     this->stream = NULL;
 }
 myPubSubClient::myPubSubClient(uint8_t *ip, uint16_t port, Client& client, Stream& stream) {
     this->_state = MQTT_DISCONNECTED;
+    this->buffer = NULL;
+    this->rxBuffer = NULL;
+    this->bufferSize = 0;
+    setBufferSize(MQTT_MAX_PACKET_SIZE);
     setServer(ip,port);
     setClient(client);
     setStream(stream);
 }
 myPubSubClient::myPubSubClient(uint8_t *ip, uint16_t port, MQTT_CALLBACK_SIGNATURE, Client& client) {
     this->_state = MQTT_DISCONNECTED;
+    this->buffer = NULL;
+    this->rxBuffer = NULL;
+    this->bufferSize = 0;
+    setBufferSize(MQTT_MAX_PACKET_SIZE);
     setServer(ip, port);
     setCallback(callback);
     setClient(client);
@@ -68,6 +104,10 @@ myPubSubClient::myPubSubClient(uint8_t *ip, uint16_t port, MQTT_CALLBACK_SIGNATU
 }
 myPubSubClient::myPubSubClient(uint8_t *ip, uint16_t port, MQTT_CALLBACK_SIGNATURE, Client& client, Stream& stream) {
     this->_state = MQTT_DISCONNECTED;
+    this->buffer = NULL;
+    this->rxBuffer = NULL;
+    this->bufferSize = 0;
+    setBufferSize(MQTT_MAX_PACKET_SIZE);
     setServer(ip,port);
     setCallback(callback);
     setClient(client);
@@ -76,18 +116,30 @@ myPubSubClient::myPubSubClient(uint8_t *ip, uint16_t port, MQTT_CALLBACK_SIGNATU
 
 myPubSubClient::myPubSubClient(const char* domain, uint16_t port, Client& client) {
     this->_state = MQTT_DISCONNECTED;
+    this->buffer = NULL;
+    this->rxBuffer = NULL;
+    this->bufferSize = 0;
+    setBufferSize(MQTT_MAX_PACKET_SIZE);
     setServer(domain,port);
     setClient(client);
     this->stream = NULL;
 }
 myPubSubClient::myPubSubClient(const char* domain, uint16_t port, Client& client, Stream& stream) {
     this->_state = MQTT_DISCONNECTED;
+    this->buffer = NULL;
+    this->rxBuffer = NULL;
+    this->bufferSize = 0;
+    setBufferSize(MQTT_MAX_PACKET_SIZE);
     setServer(domain,port);
     setClient(client);
     setStream(stream);
 }
 myPubSubClient::myPubSubClient(const char* domain, uint16_t port, MQTT_CALLBACK_SIGNATURE, Client& client) {
     this->_state = MQTT_DISCONNECTED;
+    this->buffer = NULL;
+    this->rxBuffer = NULL;
+    this->bufferSize = 0;
+    setBufferSize(MQTT_MAX_PACKET_SIZE);
     setServer(domain,port);
     setCallback(callback);
     setClient(client);
@@ -95,12 +147,21 @@ myPubSubClient::myPubSubClient(const char* domain, uint16_t port, MQTT_CALLBACK_
 }
 myPubSubClient::myPubSubClient(const char* domain, uint16_t port, MQTT_CALLBACK_SIGNATURE, Client& client, Stream& stream) {
     this->_state = MQTT_DISCONNECTED;
+    this->buffer = NULL;
+    this->rxBuffer = NULL;
+    this->bufferSize = 0;
+    setBufferSize(MQTT_MAX_PACKET_SIZE);
     setServer(domain,port);
     setCallback(callback);
     setClient(client);
     setStream(stream);
 }
 
+myPubSubClient::~myPubSubClient() {
+    free(this->buffer);
+    free(this->rxBuffer);
+}
+
 boolean myPubSubClient::connect(const char *id) {
     return connect(id,NULL,NULL,0,0,0,0,1);
 }
@@ -138,6 +199,7 @@ boolean myPubSubClient::connect(const char *id, const char *user, const char *pa
     }
     
     nextMsgId = 1;
+    rxState = RX_HEADER;
     // Leave room in the buffer for header and variable length field
     uint16_t length = MQTT_MAX_HEADER_SIZE;
     unsigned int j;
@@ -198,25 +260,29 @@ boolean myPubSubClient::connect(const char *id, const char *user, const char *pa
 
     lastInActivity = lastOutActivity = millis();
 
-    while (!_client->available()) {
+    uint8_t llen;
+    uint32_t len;
+    while ((len = readPacket(&llen)) == 0) {
         unsigned long t = millis();
+        if (!_client->connected()) {
+            _state = MQTT_CONNECTION_LOST;
+            return false;
+        }
         if (t-lastInActivity >= ((int32_t) MQTT_SOCKET_TIMEOUT*1000UL)) {
             _state = MQTT_CONNECTION_TIMEOUT;
             _client->stop();
             return false;
         }
     }
-    uint8_t llen;
-    uint32_t len = readPacket(&llen);
 
     if (len == 4) {
-        if (buffer[3] == 0) {
+        if (rxBuffer[3] == 0) {
             lastInActivity = millis();
             pingOutstanding = false;
             _state = MQTT_CONNECTED;
             return true;
         } else {
-            _state = buffer[3];
+            _state = rxBuffer[3];
         }
     }
     _client->stop();
@@ -261,6 +327,7 @@ boolean myPubSubClient::beginConnect(const char *id, const char *user, const cha
     }
     
     nextMsgId = 1;
+    rxState = RX_HEADER;
     // Leave room in the buffer for header and variable length field
     uint16_t length = MQTT_MAX_HEADER_SIZE;
     unsigned int j;
@@ -328,29 +395,30 @@ int myPubSubClient::connectStatus(void) {
     if (_state != MQTT_CONNECT_INPROGRESS)
         return _state;
         
-    /* if there's nothing to read, check if we still have time */
-    if (!_client->available()) {
+    /* read what's available of what should be a CONNACK */
+    uint8_t llen;
+    uint16_t len = readPacket(&llen);
+
+    /* if it's not complete yet, check if we still have time */
+    if (len == 0) {
+        if (_state != MQTT_CONNECT_INPROGRESS)
+            return _state;  /* readPacket() has closed the connection */
         unsigned long t = millis();
         if (t-lastInActivity >= ((int32_t) MQTT_SOCKET_TIMEOUT*1000UL)) {
             _state = MQTT_CONNECTION_TIMEOUT;
             _client->stop();
-            return _state;
         }
         return _state;
     }
-    
-    /* read and parse what should be a CONNACK */
-    uint8_t llen;
-    uint16_t len = readPacket(&llen);
 
     if (len == 4) {
-        if (buffer[0] == MQTTCONNACK && buffer[3] == 0) {
+        if (rxBuffer[0] == MQTTCONNACK && rxBuffer[3] == 0) {
             lastInActivity = millis();
             pingOutstanding = false;
             _state = MQTT_CONNECTED;
             return _state;
         } else {
-            _state = buffer[3];
+            _state = rxBuffer[3];
         }
     }
     
@@ -359,87 +427,95 @@ int myPubSubClient::connectStatus(void) {
     return _state;
 }
 
-// reads a byte into result
-boolean myPubSubClient::readByte(uint8_t * result) {
-   uint32_t previousMillis = millis();
-   while(!_client->available()) {
-     yield();
-     uint32_t currentMillis = millis();
-     if(currentMillis - previousMillis >= ((int32_t) MQTT_SOCKET_TIMEOUT * 1000)){
-       return false;
-     }
-   }
-   *result = _client->read();
-   return true;
-}
-
-// reads a byte into result[*index] and increments index
-boolean myPubSubClient::readByte(uint8_t * result, uint16_t * index){
-  uint16_t current_index = *index;
-  uint8_t * write_address = &(result[current_index]);
-  if(readByte(write_address)){
-    *index = current_index + 1;
-    return true;
-  }
-  return false;
-}
-
+// Incremental packet decoder.  Consumes whatever bytes are available from the 
+// client, without waiting for more, and assembles the packet in rxBuffer, 
+// which nothing sent in the meantime touches.  Returns the length of the 
+// packet in rxBuffer once it's complete, or 0 if it's not complete yet.  
+// Packets too big for the buffer are discarded (unless a stream has been 
+// set), again returning 0.
 uint32_t myPubSubClient::readPacket(uint8_t* lengthLength) {
-    uint16_t len = 0;
-    if(!readByte(buffer, &len)) return 0;
-    bool isPublish = (buffer[0]&0xF0) == MQTTPUBLISH;
-    uint32_t multiplier = 1;
-    uint32_t length = 0;
-    uint8_t digit = 0;
-    uint16_t skip = 0;
-    uint8_t start = 0;
-
-    do {
-        if (len == 5) {
-            // Invalid remaining length encoding - kill the connection
-            _state = MQTT_DISCONNECTED;
-            _client->stop();
-            return 0;
-        }
-        if(!readByte(&digit)) return 0;
-        buffer[len++] = digit;
-        length += (digit & 127) * multiplier;
-        multiplier *= 128;
-    } while ((digit & 128) != 0);
-    *lengthLength = len-1;
-
-    if (isPublish) {
-        // Read in topic length to calculate bytes to skip over for Stream writing
-        if(!readByte(buffer, &len)) return 0;
-        if(!readByte(buffer, &len)) return 0;
-        skip = (buffer[*lengthLength+1]<<8)+buffer[*lengthLength+2];
-        start = 2;
-        if (buffer[0]&MQTTQOS1) {
-            // skip message id
-            skip += 2;
+    while (_client->available() > 0) {
+        switch (rxState) {
+        case RX_HEADER:
+            rxBuffer[0] = _client->read();
+            rxLen = 1;
+            rxLength = 0;
+            rxCount = 0;
+            rxSkip = 0;
+            rxMultiplier = 1;
+            rxState = RX_LENGTH;
+            break;
+
+        case RX_LENGTH: {
+            if (rxLen == 5) {
+                // Invalid remaining length encoding - kill the connection
+                rxState = RX_HEADER;
+                _state = MQTT_DISCONNECTED;
+                _client->stop();
+                return 0;
+            }
+            uint8_t digit = _client->read();
+            rxBuffer[rxLen++] = digit;
+            rxLength += (digit & 127) * rxMultiplier;
+            rxMultiplier *= 128;
+            if ((digit & 128) == 0) {
+                rxLengthLength = rxLen-1;
+                rxState = RX_BODY;
+            }
+            break;
         }
-    }
 
-    uint32_t idx = len;
-    for (uint32_t i = start;i<length;i++) {
-        if(!readByte(&digit)) return 0;
-        if (this->stream) {
-            if (isPublish && idx-*lengthLength-2>skip) {
-                this->stream->write(digit);
+        case RX_BODY: {
+            bool isPublish = (rxBuffer[0]&0xF0) == MQTTPUBLISH;
+            if (this->stream == NULL && rxLen < this->bufferSize && rxCount < rxLength) {
+                // Read as much as is available into the rxBuffer in one go.
+                uint32_t count = rxLength - rxCount;
+                if (count > (uint32_t)(this->bufferSize - rxLen)) count = this->bufferSize - rxLen;
+                int available = _client->available();
+                if (count > (uint32_t)available) count = available;
+                int n = _client->read(rxBuffer+rxLen, count);
+                if (n <= 0) return 0;
+                rxLen += n;
+                rxCount += n;
+            } else if (rxCount < rxLength) {
+                // Bytes streamed out or discarded are read one at a time.
+                uint8_t digit = _client->read();
+                if (this->stream && isPublish && rxCount >= 2 && rxCount-2 >= rxSkip) {
+                    this->stream->write(digit);
+                }
+                if (rxLen < this->bufferSize) {
+                    rxBuffer[rxLen++] = digit;
+                }
+                rxCount++;
+                if (isPublish && rxCount == 2) {
+                    // Topic length received, so calculate bytes to skip over for Stream writing
+                    rxSkip = (rxBuffer[rxLengthLength+1]<<8)+rxBuffer[rxLengthLength+2];
+                    if (rxBuffer[0]&MQTTQOS1) {
+                        // skip message id
+                        rxSkip += 2;
+                    }
+                }
+            }
+            if (rxCount >= rxLength) {
+                // Packet complete
+                rxState = RX_HEADER;
+                *lengthLength = rxLengthLength;
+                if (!this->stream && 1+rxLengthLength+rxLength > this->bufferSize) {
+                    return 0; // Packet is ignored.
+                }
+                return rxLen;
             }
+            break;
         }
-        if (len < MQTT_MAX_PACKET_SIZE) {
-            buffer[len] = digit;
-            len++;
         }
-        idx++;
     }
-
-    if (!this->stream && idx > MQTT_MAX_PACKET_SIZE) {
-        len = 0; // This will cause the packet to be ignored.
+    // A packet with no body is complete as soon as its length has been read.
+    if (rxState == RX_BODY && rxLength == 0) {
+        rxState = RX_HEADER;
+        *lengthLength = rxLengthLength;
+        return rxLen;
     }
-
-    return len;
+    return 0;
 }
 
 boolean myPubSubClient::loop() {
@@ -455,21 +531,15 @@ boolean myPubSubClient::loop() {
             _client->stop();
             return false;
         } else {
-            buffer[0] = MQTTPINGREQ;
-            buffer[1] = 0;
-            _client->write(buffer,2);
+            uint8_t ping[2] = { MQTTPINGREQ, 0 };
+            _client->write(ping,2);
             lastOutActivity = t;
             lastInActivity = t;
             pingOutstanding = true;
         }
     }
     
-    /* if there's nothing to read */
-    if (!_client->available()) {
-        return true;
-    }
-    
-    /* Read and parse a packet */
+    /* Read whatever is available of a packet, and parse it when complete */
     uint8_t llen;
     uint16_t len = readPacket(&llen);
     uint16_t msgId = 0;
@@ -480,35 +550,31 @@ boolean myPubSubClient::loop() {
     }
     
     lastInActivity = t;
-    uint8_t type = buffer[0]&0xF0;
+    uint8_t type = rxBuffer[0]&0xF0;
     if (type == MQTTPUBLISH) {
         if (callback) {
-            uint16_t tl = (buffer[llen+1]<<8)+buffer[llen+2]; /* topic length in bytes */
-            memmove(buffer+llen+2,buffer+llen+3,tl); /* move topic inside buffer 1 byte to front */
-            buffer[llen+2+tl] = 0; /* end the topic as a 'C' string with \x00 */
-            char *topic = (char*) buffer+llen+2;
+            uint16_t tl = (rxBuffer[llen+1]<<8)+rxBuffer[llen+2]; /* topic length in bytes */
+            memmove(rxBuffer+llen+2,rxBuffer+llen+3,tl); /* move topic inside rxBuffer 1 byte to front */
+            rxBuffer[llen+2+tl] = 0; /* end the topic as a 'C' string with \x00 */
+            char *topic = (char*) rxBuffer+llen+2;
             // msgId only present for QOS>0
-            if ((buffer[0]&0x06) == MQTTQOS1) {
-                msgId = (buffer[llen+3+tl]<<8)+buffer[llen+3+tl+1];
-                payload = buffer+llen+3+tl+2;
+            if ((rxBuffer[0]&0x06) == MQTTQOS1) {
+                msgId = (rxBuffer[llen+3+tl]<<8)+rxBuffer[llen+3+tl+1];
+                payload = rxBuffer+llen+3+tl+2;
                 callback(topic,payload,len-llen-3-tl-2);
 
-                buffer[0] = MQTTPUBACK;
-                buffer[1] = 2;
-                buffer[2] = (msgId >> 8);
-                buffer[3] = (msgId & 0xFF);
-                _client->write(buffer,4);
+                uint8_t puback[4] = { MQTTPUBACK, 2, (uint8_t)(msgId >> 8), (uint8_t)(msgId & 0xFF) };
+                _client->write(puback,4);
                 lastOutActivity = t;
 
             } else {
-                payload = buffer+llen+3+tl;
+                payload = rxBuffer+llen+3+tl;
                 callback(topic,payload,len-llen-3-tl);
             }
         }
     } else if (type == MQTTPINGREQ) {
-        buffer[0] = MQTTPINGRESP;
-        buffer[1] = 0;
-        _client->write(buffer,2);
+        uint8_t pingresp[2] = { MQTTPINGRESP, 0 };
+        _client->write(pingresp,2);
     } else if (type == MQTTPINGRESP) {
         pingOutstanding = false;
     }
@@ -517,11 +583,11 @@ boolean myPubSubClient::loop() {
 }
 
 boolean myPubSubClient::publish(const char* topic, const char* payload) {
-    return publish(topic,(const uint8_t*)payload, payload ? strnlen(payload, MQTT_MAX_PACKET_SIZE) : 0,false);
+    return publish(topic,(const uint8_t*)payload, payload ? strnlen(payload, this->bufferSize) : 0,false);
 }
 
 boolean myPubSubClient::publish(const char* topic, const char* payload, boolean retained) {
-    return publish(topic,(const uint8_t*)payload, payload ? strnlen(payload, MQTT_MAX_PACKET_SIZE) : 0,retained);
+    return publish(topic,(const uint8_t*)payload, payload ? strnlen(payload, this->bufferSize) : 0,retained);
 }
 
 boolean myPubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int plength) {
@@ -530,7 +596,7 @@ boolean myPubSubClient::publish(const char* topic, const uint8_t* payload, unsig
 
 boolean myPubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int plength, boolean retained) {
     if (connected()) {
-        if (MQTT_MAX_PACKET_SIZE < MQTT_MAX_HEADER_SIZE + 2+strlen(topic) + plength) {
+        if (this->bufferSize < MQTT_MAX_HEADER_SIZE + 2+strlen(topic) + plength) {
             // Too long
             return false;
         }
@@ -555,7 +621,7 @@ boolean myPubSubClient::publish(const char* topic, const uint8_t* payload, unsig
 }
 
 boolean myPubSubClient::publish_P(const char* topic, const char* payload, boolean retained) {
-    return publish_P(topic, (const uint8_t*)payload, payload ? strnlen(payload, MQTT_MAX_PACKET_SIZE) : 0, retained);
+    return publish_P(topic, (const uint8_t*)payload, payload ? strnlen(payload, this->bufferSize) : 0, retained);
 }
 
 boolean myPubSubClient::publish_P(const char* topic, const uint8_t* payload, unsigned int plength, boolean retained) {
@@ -688,14 +754,14 @@ boolean myPubSubClient::subscribe(const char* topic) {
 }
 
 boolean myPubSubClient::subscribe(const char* topic, uint8_t qos) {
-    size_t topicLength = strnlen(topic, MQTT_MAX_PACKET_SIZE);
+    size_t topicLength = strnlen(topic, this->bufferSize);
     if (topic == 0) {
         return false;
     }
     if (qos > 1) {
         return false;
     }
-    if (MQTT_MAX_PACKET_SIZE < 9 + topicLength) {
+    if (this->bufferSize < 9 + topicLength) {
         // Too long
         return false;
     }
@@ -716,11 +782,11 @@ boolean myPubSubClient::subscribe(const char* topic, uint8_t qos) {
 }
 
 boolean myPubSubClient::unsubscribe(const char* topic) {
-  size_t topicLength = strnlen(topic, MQTT_MAX_PACKET_SIZE);
+  size_t topicLength = strnlen(topic, this->bufferSize);
     if (topic == 0) {
         return false;
     }
-    if (MQTT_MAX_PACKET_SIZE < 9 + topicLength) {
+    if (this->bufferSize < 9 + topicLength) {
         // Too long
         return false;
     }
@@ -812,6 +878,32 @@ myPubSubClient& myPubSubClient::setStream(Stream& stream){
     return *this;
 }
 
+boolean myPubSubClient::setBufferSize(uint16_t size) {
+    if (size == 0) {
+        // Cannot set it back to 0
+        return false;
+    }
+    uint8_t* newBuffer = (uint8_t*)realloc(this->buffer, size);
+    if (newBuffer == NULL) {
+        return false;
+    }
+    this->buffer = newBuffer;
+    // Incoming packets have a buffer of their own, as a packet may arrive
+    // over several loop() calls with packets sent in between.
+    newBuffer = (uint8_t*)realloc(this->rxBuffer, size);
+    if (newBuffer == NULL) {
+        return false;
+    }
+    this->rxBuffer = newBuffer;
+    this->bufferSize = size;
+    this->rxState = RX_HEADER;
+    return true;
+}
+
+uint16_t myPubSubClient::getBufferSize() {
+    return this->bufferSize;
+}
+
 int myPubSubClient::state() {
     return this->_state;
 }
@@ -22,7 +22,8 @@
 #define MQTT_VERSION MQTT_VERSION_3_1_1
 #endif
 
-// MQTT_MAX_PACKET_SIZE : Maximum packet size
+// MQTT_MAX_PACKET_SIZE : Default maximum packet size.  The size of each of the
+//  send and receive buffers can also be changed at run time with setBufferSize().
 #ifndef MQTT_MAX_PACKET_SIZE
 #define MQTT_MAX_PACKET_SIZE 128
 #endif
@@ -32,7 +33,9 @@
 #define MQTT_KEEPALIVE 15
 #endif
 
-// MQTT_SOCKET_TIMEOUT: socket timeout interval in Seconds
+// MQTT_SOCKET_TIMEOUT: socket timeout interval in Seconds.  Incoming packets are
+//  assembled a piece at a time as data arrives, so this is only used for the
+//  blocking connect() and for timing out a non-blocking connection attempt.
 #ifndef MQTT_SOCKET_TIMEOUT
 #define MQTT_SOCKET_TIMEOUT 15
 #endif
@@ -85,20 +88,29 @@
 #define MQTT_CALLBACK_SIGNATURE void (*callback)(char*, uint8_t*, unsigned int)
 #endif
 
-#define CHECK_STRING_LENGTH(l,s) if (l+2+strlen(s) > MQTT_MAX_PACKET_SIZE) {_client->stop();return false;}
+#define CHECK_STRING_LENGTH(l,s) if (l+2+strlen(s) > this->bufferSize) {_client->stop();return false;}
 
 class myPubSubClient : public Print {
 private:
    Client* _client;
-   uint8_t buffer[MQTT_MAX_PACKET_SIZE];
+   uint8_t* buffer;          // Packets being sent
+   uint8_t* rxBuffer;        // Packet being received, the same size
+   uint16_t bufferSize;
    uint16_t nextMsgId;
    unsigned long lastOutActivity;
    unsigned long lastInActivity;
    bool pingOutstanding;
    MQTT_CALLBACK_SIGNATURE;
    uint32_t readPacket(uint8_t*);
-   boolean readByte(uint8_t * result);
-   boolean readByte(uint8_t * result, uint16_t * index);
+   // State of the incoming packet decoder
+   enum : uint8_t { RX_HEADER, RX_LENGTH, RX_BODY };
+   uint8_t rxState;
+   uint8_t rxLengthLength;   // Number of bytes in the remaining length field
+   uint16_t rxLen;           // Number of bytes stored in rxBuffer
+   uint16_t rxSkip;          // Bytes of PUBLISH body before the payload (less 2)
+   uint32_t rxLength;        // Remaining length of the packet from the header
+   uint32_t rxCount;         // Number of bytes of the remaining length received
+   uint32_t rxMultiplier;
    boolean write(uint8_t header, uint8_t* buf, uint16_t length);
    uint16_t writeString(const char* string, uint8_t* buf, uint16_t pos);
    // Build up the header ready to send
@@ -127,6 +139,8 @@ public:
    myPubSubClient(const char*, uint16_t, MQTT_CALLBACK_SIGNATURE,Client& client);
    myPubSubClient(const char*, uint16_t, MQTT_CALLBACK_SIGNATURE,Client& client, Stream&);
 
+   ~myPubSubClient();
+
    myPubSubClient& setServer(IPAddress ip, uint16_t port);
    myPubSubClient& setServer(uint8_t * ip, uint16_t port);
    myPubSubClient& setServer(const char * domain, uint16_t port);
@@ -134,6 +148,11 @@ public:
    myPubSubClient& setClient(Client& client);
    myPubSubClient& setStream(Stream& stream);
 
+   // Change the size of the packet buffer.  Returns false if the memory
+   //  couldn't be allocated, in which case the buffer is left unchanged.
+   boolean setBufferSize(uint16_t size);
+   uint16_t getBufferSize();
+
    boolean connect(const char* id);
    boolean connect(const char* id, const char* user, const char* pass);
    boolean connect(const char* id, const char* willTopic, uint8_t willQos, boolean willRetain, const char* willMessage);
@@ -0,0 +1,144 @@
+/*
+ *  © 2026 agent
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Test of BinaryProtocol::parse with frames split across reads.  Whole
+ * frames are executed; a frame cut short by the end of a read is answered
+ * with OP_ERROR and counted, and its remainder in the next read is ignored.
+ * A frame failing its CRC is skipped, and ids out of the range of the text
+ * commands are rejected rather than narrowed onto another loco or turnout.
+ */
+
+#include <string>
+#include "DCC.h"
+#include "MotorDrivers.h"
+#include "BinaryProtocol.h"
+#include "Turnouts.h"
+#include "EXRAIL2.h"
+#include "check.h"
+
+// Collects the replies to the client.
+class Reply : public Print {
+public:
+  std::string text;
+  size_t write(uint8_t b) override { text += (char)b; return 1; }
+};
+
+static std::string frame(byte opcode, byte count, const int32_t params[]) {
+  byte buffer[BinaryProtocol::MAX_FRAME];
+  byte length = BinaryProtocol::encode(buffer, opcode, count, params);
+  return std::string((char *)buffer, length);
+}
+
+static std::string throttle(int32_t cab, int32_t speed) {
+  int32_t p[] = {cab, speed, 1};
+  return frame(BinaryProtocol::OP_THROTTLE, 3, p);
+}
+
+static std::string function(int32_t cab, int32_t fn, int32_t on) {
+  int32_t p[] = {cab, fn, on};
+  return frame(BinaryProtocol::OP_FUNCTION, 3, p);
+}
+
+static std::string turnout(int32_t id, int32_t closed) {
+  int32_t p[] = {id, closed};
+  return frame(BinaryProtocol::OP_TURNOUT, 2, p);
+}
+
+static std::string error(byte opcode) {
+  int32_t p[] = {opcode};
+  return frame(BinaryProtocol::OP_ERROR, 1, p);
+}
+
+static std::string parse(const std::string &read) {
+  Reply reply;
+  BinaryProtocol::parse(&reply, (const byte *)read.data(), read.size());
+  advanceMicros(100000);  // let the DCC interrupt send the packets
+  return reply.text;
+}
+
+int main() {
+  DCC::begin(STANDARD_MOTOR_SHIELD);
+  RMFT2::begin();  // as in setup(); turnout changes raise EXRAIL events
+
+  // Whole frame
+  CHECK(parse(throttle(3, 50)) == "");
+  CHECK(DCC::getThrottleSpeed(3) == 51);
+  CHECK(BinaryProtocol::truncatedFrames == 0);
+
+  // Split at every point: the first part is rejected, the rest ignored.
+  std::string whole = throttle(3, 20);
+  for (size_t split = 1; split < whole.size(); split++) {
+    unsigned int truncated = BinaryProtocol::truncatedFrames;
+    CHECK(parse(whole.substr(0, split)) == error(split > 2 ? BinaryProtocol::OP_THROTTLE : 0));
+    CHECK(BinaryProtocol::truncatedFrames == truncated + 1);
+    CHECK(parse(whole.substr(split)) == "");
+    CHECK(DCC::getThrottleSpeed(3) == 51);
+  }
+
+  // Whole frames before a truncated one are still executed.
+  std::string read = throttle(4, 10) + throttle(5, 11) + throttle(6, 12).substr(0, 4);
+  CHECK(parse(read) == error(BinaryProtocol::OP_THROTTLE));
+  CHECK(DCC::getThrottleSpeed(4) == 11);
+  CHECK(DCC::getThrottleSpeed(5) == 12);
+  CHECK(DCC::lookupSpeedTable(6, false) < 0);
+
+  // A START with no opcode is skipped, not taken as a truncated frame.
+  unsigned int truncated = BinaryProtocol::truncatedFrames;
+  CHECK(parse(std::string("\xA5\x00", 2) + throttle(7, 30)) == "");
+  CHECK(DCC::getThrottleSpeed(7) == 31);
+  CHECK(BinaryProtocol::truncatedFrames == truncated);
+
+  // A frame failing its CRC is skipped silently, and the next is found.
+  std::string bad = throttle(8, 40);
+  bad[bad.size() - 1] ^= 0x55;
+  CHECK(parse(bad) == "");
+  CHECK(DCC::lookupSpeedTable(8, false) < 0);
+  CHECK(parse(bad + throttle(8, 40)) == "");
+  CHECK(DCC::getThrottleSpeed(8) == 41);
+  CHECK(BinaryProtocol::truncatedFrames == truncated);
+
+  // Functions
+  CHECK(parse(function(3, 2, 1)) == "");
+  CHECK(DCC::getFn(3, 2) == 1);
+  CHECK(parse(function(3, 2, 0)) == "");
+  CHECK(DCC::getFn(3, 2) == 0);
+
+  // Turnouts
+  DCCTurnout::create(1, 100, 0);
+  CHECK(parse(turnout(1, 1)) == "");
+  CHECK(Turnout::isClosed(1));
+  CHECK(parse(turnout(1, 0)) == "");
+  CHECK(!Turnout::isClosed(1));
+  CHECK(parse(turnout(2, 1)) == error(BinaryProtocol::OP_TURNOUT));  // no such turnout
+
+  // Ids beyond the text commands' range are rejected, not narrowed.
+  CHECK(parse(throttle(65539, 90)) == error(BinaryProtocol::OP_THROTTLE));
+  CHECK(parse(throttle(-1, 90)) == error(BinaryProtocol::OP_THROTTLE));
+  CHECK(parse(throttle(10240, 90)) == error(BinaryProtocol::OP_THROTTLE));
+  CHECK(DCC::getThrottleSpeed(3) == 51);
+  CHECK(parse(function(65539, 2, 1)) == error(BinaryProtocol::OP_FUNCTION));
+  CHECK(parse(function(3, 65538, 1)) == error(BinaryProtocol::OP_FUNCTION));
+  CHECK(DCC::getFn(3, 2) == 0);
+  CHECK(parse(turnout(65537, 1)) == error(BinaryProtocol::OP_TURNOUT));
+  CHECK(!Turnout::isClosed(1));
+
+  return checkResult("binary_protocol_test");
+}
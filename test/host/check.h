@@ -0,0 +1,41 @@
+/*
+ *  © 2026 agent
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef check_h
+#define check_h
+#include <stdio.h>
+
+// Minimal checking for the host tests.  A failed CHECK() is reported and the
+// test carries on; checkResult() gives main() its exit status.
+static int checkCount = 0;
+static int checkFailures = 0;
+
+#define CHECK(condition) do { \
+    checkCount++; \
+    if (!(condition)) { \
+      checkFailures++; \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+    } \
+  } while (0)
+
+static inline int checkResult(const char *name) {
+  printf("%s: %d checks, %d failed\n", name, checkCount, checkFailures);
+  return checkFailures ? 1 : 0;
+}
+#endif
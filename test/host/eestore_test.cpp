@@ -0,0 +1,229 @@
+/*
+ *  © 2026 agent
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Test of the EEStore state log on the emulated EEPROM, across restarts.
+ *
+ * On a Mega, turnout changes are written round the log rather than in
+ * place, so the most any one byte is written is a small fraction of the
+ * changes to the busiest turnout, and the states survive a restart.  No
+ * call to EEStore::loop() writes more than EESTORE_WRITES_PER_LOOP bytes or
+ * waits, even while the queue is full and the log is being compacted, and
+ * none reads more than a scan of the log for each byte it may write (an
+ * external EEPROM is read over I2C).
+ *
+ * On a 1KB EEPROM, saving definitions that reach into the log (<E> or an
+ * image from before there was a log) leaves the log unused: nothing there
+ * is erased, at the time or at the next startup, and the states are written
+ * in place.  Removing enough definitions brings the log back.
+ */
+
+#include <sys/wait.h>
+#include <unistd.h>
+#include "DCC.h"
+#include "MotorDrivers.h"
+#include "EEStore.h"
+#include "Turnouts.h"
+#include "EXRAIL2.h"
+#include "check.h"
+
+#define TURNOUTS 20
+#define CHANGES 4000
+
+// Each session runs in a child process that starts the command station on
+// the EEPROM contents left by the last session, as after a restart, and
+// passes back its checks and the contents it leaves.
+static void session(void (*run)()) {
+  int fds[2];
+  if (pipe(fds) != 0) return;
+  fflush(stdout);
+  if (fork() == 0) {
+    close(fds[0]);
+    checkCount = checkFailures = 0;
+    EEPROM.resetCounts();
+    DCC::begin(STANDARD_MOTOR_SHIELD);
+    RMFT2::begin();  // as in setup(); turnout changes raise EXRAIL events
+    run();
+    fflush(stdout);
+    int counts[] = {checkCount, checkFailures};
+    if (write(fds[1], counts, sizeof(counts)) != sizeof(counts)
+        || write(fds[1], EEPROM.contents(), EEPROM.length()) != EEPROM.length()) _exit(1);
+    _exit(0);
+  }
+  close(fds[1]);
+  int counts[2];
+  bool ok = read(fds[0], counts, sizeof(counts)) == sizeof(counts);
+  for (size_t got = 0, n = 1; ok && got < EEPROM.length() && n > 0; got += n)
+    n = read(fds[0], EEPROM.contents() + got, EEPROM.length() - got);
+  close(fds[0]);
+  int status;
+  wait(&status);
+  CHECK(ok && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  if (ok) {
+    checkCount += counts[0];
+    checkFailures += counts[1];
+  }
+}
+
+static int logBase() {
+  return EEPROM.length() - min(EESTORE_LOG_SIZE, EEPROM.length() / 8);
+}
+
+static void setState(uint16_t id, bool closed) {
+  Turnout::setClosed(id, closed);
+  // Give the write-behind queue time to write a record, a byte per loop
+  // as the main loop does, and the DCC interrupt time to send the packets.
+  for (int i = 0; i < 8; i++) {
+    EEStore::loop();
+    advanceMicros(4000);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Write amplification on a 4KB EEPROM
+///////////////////////////////////////////////////////////////////////////////
+
+static bool expected[TURNOUTS + 1];  // closed
+
+// Every other change is to turnout 1, and the rest go round the others.
+static uint16_t changed(unsigned long i) {
+  return (i % 2 == 0) ? 1 : 2 + (i / 2) % (TURNOUTS - 1);
+}
+
+static void defineTurnouts() {
+  for (int id = 1; id <= TURNOUTS; id++) VpinTurnout::create(id, 1000 + id);
+  EEStore::store();
+}
+
+static void checkStates() {
+  CHECK(EEStore::eeStore->data.nTurnouts == TURNOUTS);
+  for (int id = 1; id <= TURNOUTS; id++)
+    CHECK(Turnout::exists(id) && Turnout::isClosed(id) == expected[id]);
+}
+
+static void makeChanges() {
+  checkStates();
+  EEPROM.resetCounts();
+  for (unsigned long i = 0; i < CHANGES; i++) setState(changed(i), !Turnout::isClosed(changed(i)));
+  EEStore::flush();
+  unsigned long most = 0;
+  for (int a = 0; a < EEPROM.length(); a++) most = max(most, EEPROM.writes[a]);
+  printf("%d turnout changes, %d to one turnout: %.2f byte writes per change, "
+    "at most %lu to one byte\n", CHANGES, CHANGES / 2, (double)EEPROM.writeCount / CHANGES, most);
+  CHECK(most < CHANGES / 2 / 10);
+}
+
+#define BUDGET_ROUNDS 25
+#define BUDGET_TURNOUTS 10
+
+static void loopBudget() {
+  checkStates();
+  unsigned long most = 0, mostReads = 0;
+  for (int round = 0; round < BUDGET_ROUNDS; round++) {
+    for (int id = 1; id <= BUDGET_TURNOUTS; id++) Turnout::setClosed(id, !Turnout::isClosed(id));
+    for (int i = 0; i < 200; i++) {
+      unsigned long writes = EEPROM.writeCount, reads = EEPROM.readCount, start = micros();
+      EEStore::loop();
+      most = max(most, EEPROM.writeCount - writes);
+      mostReads = max(mostReads, EEPROM.readCount - reads);
+      CHECK(EEPROM.writeCount - writes <= EESTORE_WRITES_PER_LOOP);
+      CHECK(micros() == start);
+    }
+  }
+  printf("EEStore::loop(): at most %lu byte writes and %lu byte reads in one call\n", most, mostReads);
+  CHECK(most == EESTORE_WRITES_PER_LOOP);
+  // A scan of the log reads the address of each record.
+  CHECK(mostReads <= EESTORE_WRITES_PER_LOOP * (EESTORE_LOG_SIZE / 2));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Definitions reaching into the log on a 1KB EEPROM
+///////////////////////////////////////////////////////////////////////////////
+
+static void growIntoLog() {
+  CHECK(EEPROM.writeCount > 0);  // log created on the blank EEPROM
+  uint16_t id = 0;
+  while (EEStore::pointer() <= logBase()) {
+    id++;
+    VpinTurnout::create(id, 1000 + id);
+    EEStore::store();  // <E>
+  }
+}
+
+static void checkDefinitions() {
+  CHECK(EEStore::pointer() > logBase());
+  CHECK(EEStore::eeStore->data.nTurnouts > 100);
+  for (uint16_t id = 1; id <= EEStore::eeStore->data.nTurnouts; id++) CHECK(Turnout::exists(id));
+}
+
+static void overlapInPlace() {
+  CHECK(EEPROM.writeCount == 0);  // nothing erased or created
+  checkDefinitions();
+  for (uint16_t id = 1; id <= 3; id++) setState(id, false);
+  EEStore::flush();
+  CHECK(EEPROM.writeCount == 3);  // a byte each, in place
+}
+
+static void overlapRemove() {
+  CHECK(EEPROM.writeCount == 0);
+  checkDefinitions();
+  for (uint16_t id = 1; id <= EEStore::eeStore->data.nTurnouts; id++)
+    CHECK(Turnout::isClosed(id) == (id > 3));
+  for (uint16_t id = EEStore::eeStore->data.nTurnouts; id > 10; id--) Turnout::remove(id);
+  EEStore::store();
+  CHECK(EEStore::pointer() <= logBase());
+}
+
+static void logAgain() {
+  CHECK(EEPROM.writeCount == 0);  // the log created by the last session was found
+  CHECK(EEStore::eeStore->data.nTurnouts == 10);
+  CHECK(!Turnout::exists(11));
+  setState(4, false);
+  EEStore::flush();
+  unsigned long logWrites = 0;
+  for (int a = logBase(); a < EEPROM.length(); a++) logWrites += EEPROM.writes[a];
+  CHECK(logWrites == EEPROM.writeCount && logWrites > 0);
+}
+
+static void checkLogAgain() {
+  for (uint16_t id = 1; id <= 10; id++) CHECK(Turnout::isClosed(id) == (id > 4));
+}
+
+int main() {
+  StringFormatter::diagSerial = NULL;  // quiet
+
+  for (int id = 1; id <= TURNOUTS; id++) expected[id] = true;
+  session(defineTurnouts);
+  session(makeChanges);
+  for (unsigned long i = 0; i < CHANGES; i++) expected[changed(i)] = !expected[changed(i)];
+  session(checkStates);
+  session(loopBudget);
+  for (int id = 1; id <= BUDGET_TURNOUTS; id++) expected[id] ^= BUDGET_ROUNDS % 2;
+  session(checkStates);
+
+  EEPROM.setLength(1024);
+  session(growIntoLog);
+  session(overlapInPlace);
+  session(overlapRemove);
+  session(logAgain);
+  session(checkLogAgain);
+
+  return checkResult("eestore_test");
+}
@@ -0,0 +1,92 @@
+/*
+ *  © 2026 agent
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Format benchmark: the host CPU time to format the loco broadcast
+ * <l cab slot speed functions> into a RingStream, as CommandDistributor
+ * does, with StringFormatter::send and with SEND_FORMAT (CompiledFormat.h).
+ *
+ *   format_benchmark [lines]
+ *
+ * Each line is marked and committed as a broadcast is, in batches that fit
+ * the ring, which is emptied between batches outside the timing.  The rates
+ * are for comparing the two on the host; an AVR is very roughly a hundred
+ * times slower.
+ */
+
+#include <chrono>
+#include "StringFormatter.h"
+#include "CompiledFormat.h"
+#include "RingStream.h"
+
+#define BATCH 32
+
+typedef std::chrono::steady_clock Clock;
+static RingStream ring(2048);
+
+static void lSend(unsigned long i) {
+  StringFormatter::send(&ring, F("<l %d %d %d %l>\n"),
+    (int)(1000 + i % 50), (int)(i % 50), (int)(i % 256), (long)i);
+}
+
+static void lSendFormat(unsigned long i) {
+  SEND_FORMAT(&ring, "<l %d %d %d %l>\n",
+    (int)(1000 + i % 50), (int)(i % 50), (int)(i % 256), (long)i);
+}
+
+// Returns the lines per second.
+static double run(const char *name, unsigned long lines, void (*format)(unsigned long i)) {
+  std::chrono::nanoseconds cpu(0);
+  unsigned long bytes = 0;
+  for (unsigned long i = 0; i < lines; ) {
+    ring.flush();
+    auto start = Clock::now();
+    for (int n = 0; n < BATCH && i < lines; n++, i++) {
+      ring.mark(0);
+      format(i);
+      ring.commit();
+    }
+    cpu += Clock::now() - start;
+    while (ring.read() >= 0) {  // client id, then the line
+      int count = ring.count();
+      bytes += count;
+      while (count--) ring.read();
+    }
+  }
+  double rate = cpu.count() ? lines * 1e9 / cpu.count() : 0;
+  printf("%-22s %10.0f lines/s %6.1fns %5.1f bytes\n", name, rate,
+    (double)cpu.count() / lines, (double)bytes / lines);
+  return rate;
+}
+
+int main(int argc, char **argv) {
+  unsigned long lines = argc > 1 ? atol(argv[1]) : 200000;
+  if (lines < 1) {
+    fprintf(stderr, "usage: format_benchmark [lines]\n");
+    return 2;
+  }
+  StringFormatter::diagSerial = NULL;  // quiet
+
+  printf("Format benchmark: %lu <l ...> lines into a RingStream, host CPU time\n", lines);
+  double send = run("StringFormatter::send", lines, lSend);
+  double compiled = run("SEND_FORMAT", lines, lSendFormat);
+  if (send > 0) printf("SEND_FORMAT is %.2fx StringFormatter::send\n", compiled / send);
+  return 0;
+}
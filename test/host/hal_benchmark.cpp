@@ -0,0 +1,84 @@
+/*
+ *  © 2026 agent
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * HAL benchmark: IODevice and the GPIO drivers running on the host against
+ * the simulated I2C bus (I2CSimulator), on virtual time.
+ *
+ *   hal_benchmark [modules] [seconds]
+ *
+ * creates <modules> simulated MCP23017s (16 pins each, default 16 = 256 pins)
+ * with I2CSimulator::createBenchmark(), which toggles one input at a time
+ * and reports the latency to the IONotifyCallback every 5 virtual seconds.
+ *
+ * Each IODevice::loop() call is charged LOOP_OVERHEAD microseconds for the
+ * rest of the command station loop, plus the time its I2C transfers would
+ * take at 400kHz (9 bit times per byte, address byte included), so the
+ * latency reflects the bus traffic that the drivers generate.  The host CPU
+ * time per loop() call is shown too, for comparing changes to the HAL code.
+ * Virtual time stands still during a loop() call, so the per-device loop
+ * times in the final statistics are zero; the I2C byte counts are real.
+ */
+
+#include <chrono>
+#include "IODevice.h"
+#include "I2CSimulator.h"
+
+#define LOOP_OVERHEAD 100       // microseconds
+#define I2C_BYTE_MICROS 22.5    // 9 bits at 400kHz
+
+int main(int argc, char **argv) {
+  int modules = argc > 1 ? atoi(argv[1]) : 16;
+  long seconds = argc > 2 ? atol(argv[2]) : 20;
+  if (modules < 1 || modules > 64 || seconds < 1) {
+    fprintf(stderr, "usage: hal_benchmark [modules 1-64] [seconds >= 1]\n");
+    return 2;
+  }
+
+  IODevice::begin();
+  I2CSimulator::createBenchmark(1000, modules, 0x50, 10000UL);
+
+  unsigned long loops = 0;
+  unsigned long endMicros = micros() + seconds * 1000000UL;
+  double i2cMicros = 0;
+  std::chrono::nanoseconds cpu(0);
+  while (micros() < endMicros) {
+    unsigned long transfers = I2CSimulator::transferCount;
+    unsigned long bytes = I2CSimulator::byteCount;
+    auto start = std::chrono::steady_clock::now();
+    IODevice::loop();
+    cpu += std::chrono::steady_clock::now() - start;
+    loops++;
+    // Charge the bus time, carrying fractions of a microsecond forward.
+    i2cMicros += ((I2CSimulator::transferCount - transfers)
+      + (I2CSimulator::byteCount - bytes)) * I2C_BYTE_MICROS;
+    unsigned long wholeMicros = (unsigned long)i2cMicros;
+    i2cMicros -= wholeMicros;
+    advanceMicros(LOOP_OVERHEAD + wholeMicros);
+  }
+
+  printf("HAL benchmark: %d MCP23017 (%d pins), %lds virtual time\n",
+    modules, modules * 16, seconds);
+  printf("loop() calls:%lu (%lu/s) I2C transfers:%lu bytes:%lu host CPU:%ldns per loop()\n",
+    loops, loops / seconds, I2CSimulator::transferCount, I2CSimulator::byteCount,
+    (long)(cpu.count() / loops));
+  IODevice::DumpStats();
+  return 0;
+}
@@ -0,0 +1,229 @@
+/*
+ *  © 2026 agent
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Test of the incremental packet decoder in myPubSubClient.  A fake client
+ * hands over the broker's bytes a few at a time (whole, one byte, and random
+ * fragments of 0-3 bytes), and the packets decoded by loop() must come out
+ * the same each way.  Neither loop() nor connectStatus() may wait: virtual
+ * time must not move during a call, and a call with nothing available must
+ * return straight away.  Publishing and PINGREQ between the reads, as
+ * IO_MQTT does, must not disturb a packet that is only partly received.
+ */
+
+#include <string>
+#include <vector>
+#include "myPubSubClient.h"
+#include "check.h"
+
+// Client which makes the broker's bytes available a fragment at a time.
+class FakeClient : public Client {
+public:
+  std::string incoming;   // everything the broker will send
+  size_t position = 0;    // bytes read so far
+  size_t allowance = 0;   // bytes that may be read before the next fragment
+  std::string sent;
+  bool isConnected = false;
+
+  int connect(IPAddress, uint16_t) override { isConnected = true; return 1; }
+  int connect(const char *, uint16_t) override { isConnected = true; return 1; }
+  size_t write(uint8_t b) override { sent += (char)b; return 1; }
+  size_t write(const uint8_t *buffer, size_t size) override {
+    sent.append((const char *)buffer, size);
+    return size;
+  }
+  int available() override { return min(allowance, incoming.size() - position); }
+  int read() override {
+    if (!available()) return -1;
+    allowance--;
+    return (uint8_t)incoming[position++];
+  }
+  int read(uint8_t *buffer, size_t size) override {
+    size_t n = min(size, (size_t)available());
+    memcpy(buffer, incoming.data() + position, n);
+    position += n;
+    allowance -= n;
+    return n;
+  }
+  int peek() override { return available() ? (uint8_t)incoming[position] : -1; }
+  void flush() override {}
+  void stop() override { isConnected = false; }
+  uint8_t connected() override { return isConnected; }
+  operator bool() override { return isConnected; }
+};
+
+struct Message {
+  std::string topic;
+  std::string payload;
+  bool operator==(const Message &other) const {
+    return topic == other.topic && payload == other.payload;
+  }
+};
+static std::vector<Message> received;
+
+static void callback(char *topic, uint8_t *payload, unsigned int length) {
+  received.push_back(Message{topic, std::string((char *)payload, length)});
+}
+
+// MQTT packet builders
+static std::string remainingLength(size_t length) {
+  std::string encoded;
+  do {
+    uint8_t digit = length % 128;
+    length /= 128;
+    if (length) digit |= 0x80;
+    encoded += (char)digit;
+  } while (length);
+  return encoded;
+}
+static std::string publishPacket(const std::string &topic, const std::string &payload, int msgId = 0) {
+  std::string body;
+  body += (char)(topic.size() >> 8);
+  body += (char)(topic.size() & 0xff);
+  body += topic;
+  if (msgId) {
+    body += (char)(msgId >> 8);
+    body += (char)(msgId & 0xff);
+  }
+  body += payload;
+  std::string packet(1, (char)(MQTTPUBLISH | (msgId ? MQTTQOS1 : 0)));
+  return packet + remainingLength(body.size()) + body;
+}
+static const std::string connack("\x20\x02\x00\x00", 4);
+static const std::string pingresp("\xd0\x00", 2);
+
+enum Fragments { WHOLE, SINGLE_BYTES, RANDOM };
+
+static size_t nextFragment(Fragments fragments) {
+  switch (fragments) {
+    case WHOLE: return 100000;
+    case SINGLE_BYTES: return 1;
+    default: return rand() % 4;
+  }
+}
+
+// Connect, then feed the broker's stream through loop() in fragments,
+// returning the messages decoded.  With interleave, each loop() call is
+// followed by a publish(), and part way through the keepalive time runs out
+// so that loop() sends a PINGREQ.
+static std::vector<Message> run(const std::string &stream, Fragments fragments,
+    uint16_t bufferSize, std::string *sent, bool interleave = false) {
+  FakeClient client;
+  myPubSubClient mqtt(IPAddress(10, 0, 0, 1), 1883, callback, client);
+  CHECK(mqtt.setBufferSize(bufferSize));
+  received.clear();
+  client.incoming = connack + stream;
+
+  CHECK(mqtt.beginConnect("test"));
+  client.sent.clear();
+  unsigned long startTime = micros();
+  int calls = 0;
+  while (mqtt.connectStatus() == MQTT_CONNECT_INPROGRESS && calls++ < 1000)
+    client.allowance = nextFragment(fragments);
+  CHECK(mqtt.state() == MQTT_CONNECTED);
+
+  calls = 0;
+  unsigned long idle = 0;
+  while ((client.position < client.incoming.size() || client.allowance) && calls++ < 100000) {
+    client.allowance = nextFragment(fragments);
+    CHECK(mqtt.loop());
+    if (interleave) {
+      CHECK(mqtt.publish("cs/out", "between reads"));
+      if (calls == 50) {
+        idle = (MQTT_KEEPALIVE + 1) * 1000000UL;
+        advanceMicros(idle);
+      }
+    }
+  }
+  // Any packet completed by the last fragment is handled by the next call.
+  client.allowance = 0;
+  for (int i = 0; i < 4; i++) CHECK(mqtt.loop());
+  CHECK(micros() == startTime + idle);  // nothing waited
+  CHECK(client.position == client.incoming.size());
+  if (sent) *sent = client.sent;
+  return received;
+}
+
+int main() {
+  std::string big(300, 'x');
+  std::string medium(180, 'm');
+  std::string stream = publishPacket("trains/turnout/1", "THROWN")
+    + pingresp
+    + publishPacket("trains/sensor/12", "1", 0x1234)
+    + publishPacket("trains/big", big)
+    + publishPacket("a", "")
+    + publishPacket("trains/medium", medium)
+    + publishPacket("trains/turnout/2", "CLOSED");
+
+  // With the default 128 byte buffer the two big packets are skipped whole,
+  // and the decoder carries on with the next.
+  std::vector<Message> expected = {
+    {"trains/turnout/1", "THROWN"},
+    {"trains/sensor/12", "1"},
+    {"a", ""},
+    {"trains/turnout/2", "CLOSED"},
+  };
+  std::string puback("\x40\x02\x12\x34", 4);
+  for (Fragments f : {WHOLE, SINGLE_BYTES}) {
+    std::string sent;
+    CHECK(run(stream, f, MQTT_MAX_PACKET_SIZE, &sent) == expected);
+    CHECK(sent == puback);  // QoS 1 publish acknowledged
+  }
+  for (unsigned seed = 1; seed <= 200; seed++) {
+    srand(seed);
+    std::string sent;
+    CHECK(run(stream, RANDOM, MQTT_MAX_PACKET_SIZE, &sent) == expected);
+    CHECK(sent == puback);
+  }
+
+  // A larger buffer takes the 180 byte payload (two byte remaining length).
+  expected.insert(expected.begin() + 3, Message{"trains/medium", medium});
+  CHECK(run(stream, SINGLE_BYTES, 256, NULL) == expected);
+  for (unsigned seed = 1; seed <= 200; seed++) {
+    srand(seed);
+    CHECK(run(stream, RANDOM, 256, NULL) == expected);
+  }
+
+  // Sending between the fragments of a packet.
+  std::string pingreq("\xc0\x00", 2);
+  expected.erase(expected.begin() + 3);
+  for (Fragments f : {SINGLE_BYTES, RANDOM}) {
+    for (unsigned seed = 1; seed <= 50; seed++) {
+      srand(seed);
+      std::string sent;
+      CHECK(run(stream, f, MQTT_MAX_PACKET_SIZE, &sent, true) == expected);
+      CHECK(sent.find(puback) != std::string::npos);
+      CHECK(sent.find(pingreq) != std::string::npos);
+    }
+  }
+
+  // Nothing available: loop() returns at once, still connected.
+  {
+    FakeClient client;
+    myPubSubClient mqtt(IPAddress(10, 0, 0, 1), 1883, callback, client);
+    client.incoming = connack;
+    client.allowance = 4;
+    CHECK(mqtt.beginConnect("test"));
+    CHECK(mqtt.connectStatus() == MQTT_CONNECTED);
+    for (int i = 0; i < 10; i++) CHECK(mqtt.loop());
+  }
+
+  return checkResult("mqtt_decoder_test");
+}
@@ -0,0 +1,121 @@
+/*
+ *  © 2026 agent
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Protocol benchmark: the host CPU time and the bytes on the wire for a
+ * throttle command and a loco broadcast, as <...> text and as BinaryProtocol
+ * frames.
+ *
+ *   protocol_benchmark [iterations]
+ *
+ * A command is a speed change from a network client, through
+ * CommandDistributor::parse as WifiInboundHandler calls it, so the time
+ * includes DCC::setThrottle and the broadcast back to the client, which
+ * both formats share.  A broadcast is formatting <l cab slot speed functions>
+ * or encoding OP_LOCO on its own.  The times are for comparing the two on
+ * the host; an AVR is very roughly a hundred times slower.
+ */
+
+#include <chrono>
+#include "DCC.h"
+#include "MotorDrivers.h"
+#include "CommandDistributor.h"
+#include "StringFormatter.h"
+
+// Output that is counted and thrown away.
+class Sink : public Print {
+public:
+  unsigned long bytes = 0;
+  size_t write(uint8_t b) override { (void)b; bytes++; return 1; }
+  size_t write(const uint8_t *buffer, size_t size) override { (void)buffer; bytes += size; return size; }
+  using Print::write;
+};
+
+typedef std::chrono::steady_clock Clock;
+static RingStream ring(2048);
+
+// Each command is made by make(buffer, i), which returns its length.
+static void commands(const char *name, byte client, unsigned long iterations,
+    int (*make)(byte *buffer, unsigned long i)) {
+  std::chrono::nanoseconds cpu(0);
+  unsigned long bytesIn = 0, bytesOut = 0;
+  for (unsigned long i = 0; i < iterations; i++) {
+    byte buffer[32];
+    int length = make(buffer, i);
+    bytesIn += length;
+    auto start = Clock::now();
+    ring.mark(client);
+    CommandDistributor::parse(client, buffer, &ring, length);
+    ring.commit();
+    cpu += Clock::now() - start;
+    while (ring.read() >= 0) {  // client id, then the reply or broadcast
+      int count = ring.count();
+      bytesOut += count;
+      while (count--) ring.read();
+    }
+    advanceMicros(20000);  // the DCC interrupt sends the packet before the next
+  }
+  CommandDistributor::forget(client);
+  printf("%-18s %6ldns %5.1f bytes in %5.1f bytes out\n", name,
+    (long)(cpu.count() / iterations), (double)bytesIn / iterations, (double)bytesOut / iterations);
+}
+
+static int textThrottle(byte *buffer, unsigned long i) {
+  return snprintf((char *)buffer, 32, "<t 1 %lu %lu 1>", 1000 + i % 50, i % 127);
+}
+
+static int binaryThrottle(byte *buffer, unsigned long i) {
+  int32_t p[] = {(int32_t)(1000 + i % 50), (int32_t)(i % 127), 1};
+  return BinaryProtocol::encode(buffer, BinaryProtocol::OP_THROTTLE, 3, p);
+}
+
+int main(int argc, char **argv) {
+  unsigned long iterations = argc > 1 ? atol(argv[1]) : 20000;
+  if (iterations < 1) {
+    fprintf(stderr, "usage: protocol_benchmark [iterations]\n");
+    return 2;
+  }
+  StringFormatter::diagSerial = NULL;  // quiet
+  DCC::begin(STANDARD_MOTOR_SHIELD);
+
+  printf("Protocol benchmark: %lu iterations, host CPU time each\n", iterations);
+  commands("text command", 0, iterations, textThrottle);
+  commands("binary command", 1, iterations, binaryThrottle);
+
+  Sink sink;
+  auto start = Clock::now();
+  for (unsigned long i = 0; i < iterations; i++)
+    StringFormatter::send(&sink, F("<l %d %d %d %l>\n"), (int)(1000 + i % 50), (int)(i % 50), (int)(i % 256), (long)i);
+  std::chrono::nanoseconds cpu = Clock::now() - start;
+  printf("%-18s %6ldns %5.1f bytes\n", "text broadcast",
+    (long)(cpu.count() / iterations), (double)sink.bytes / iterations);
+
+  unsigned long bytes = 0;
+  byte frame[BinaryProtocol::MAX_FRAME];
+  start = Clock::now();
+  for (unsigned long i = 0; i < iterations; i++) {
+    int32_t p[] = {(int32_t)(1000 + i % 50), (int32_t)(i % 50), (int32_t)(i % 256), (int32_t)i};
+    bytes += BinaryProtocol::encode(frame, BinaryProtocol::OP_LOCO, 4, p);
+  }
+  cpu = Clock::now() - start;
+  printf("%-18s %6ldns %5.1f bytes\n", "binary broadcast",
+    (long)(cpu.count() / iterations), (double)bytes / iterations);
+  return 0;
+}
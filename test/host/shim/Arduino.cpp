@@ -0,0 +1,157 @@
+/*
+ *  © 2026 agent
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <Arduino.h>
+
+static unsigned long virtualMicros = 0;
+static void (*timerHandler)() = NULL;
+static unsigned long timerPeriod;
+static unsigned long nextTick;
+
+unsigned long micros() { return virtualMicros; }
+unsigned long millis() { return virtualMicros / 1000; }
+void advanceMicros(unsigned long interval) {
+  unsigned long target = virtualMicros + interval;
+  // The handler sees the time of its own tick.
+  while (timerHandler && (long)(nextTick - target) <= 0) {
+    virtualMicros = nextTick;
+    nextTick += timerPeriod;
+    timerHandler();
+  }
+  virtualMicros = target;
+}
+void delay(unsigned long ms) { advanceMicros(ms * 1000); }
+void delayMicroseconds(unsigned int us) { advanceMicros(us); }
+
+void setTimerInterrupt(void (*handler)(), unsigned long period) {
+  timerHandler = handler;
+  timerPeriod = period;
+  nextTick = virtualMicros + period;
+}
+void yield() { advanceMicros(timerHandler ? nextTick - virtualMicros : 1); }
+
+uint8_t SREG = 0x80;
+static volatile uint8_t pinStates[NUM_DIGITAL_PINS];
+static volatile uint8_t noPin;
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (pin < NUM_DIGITAL_PINS && mode == INPUT_PULLUP) pinStates[pin] = HIGH;
+}
+void digitalWrite(uint8_t pin, uint8_t value) {
+  if (pin < NUM_DIGITAL_PINS) pinStates[pin] = value;
+}
+int digitalRead(uint8_t pin) { return pin < NUM_DIGITAL_PINS ? pinStates[pin] : LOW; }
+volatile uint8_t *portInputRegister(uint8_t port) { return port < NUM_DIGITAL_PINS ? &pinStates[port] : &noPin; }
+volatile uint8_t *portOutputRegister(uint8_t port) { return portInputRegister(port); }
+int analogRead(uint8_t pin) { (void)pin; return 0; }
+void analogWrite(uint8_t pin, int value) { (void)pin; (void)value; }
+void attachInterrupt(uint8_t interrupt, void (*handler)(), int mode) {
+  (void)interrupt; (void)handler; (void)mode;
+}
+
+long map(long x, long inMin, long inMax, long outMin, long outMax) {
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+long random(long max) { return max > 0 ? rand() % max : 0; }
+long random(long min, long max) { return max > min ? min + random(max - min) : min; }
+
+static char *unsignedToText(unsigned long value, char *buffer, int base, bool negative) {
+  char digits[34];
+  int n = 0;
+  do {
+    int digit = value % base;
+    digits[n++] = digit < 10 ? '0' + digit : 'a' + digit - 10;
+    value /= base;
+  } while (value);
+  char *p = buffer;
+  if (negative) *p++ = '-';
+  while (n) *p++ = digits[--n];
+  *p = '\0';
+  return buffer;
+}
+char *ultoa(unsigned long value, char *buffer, int base) { return unsignedToText(value, buffer, base, false); }
+char *utoa(unsigned int value, char *buffer, int base) { return unsignedToText(value, buffer, base, false); }
+char *ltoa(long value, char *buffer, int base) {
+  if (value < 0 && base == 10) return unsignedToText(-(unsigned long)value, buffer, base, true);
+  return unsignedToText((unsigned long)value, buffer, base, false);
+}
+char *itoa(int value, char *buffer, int base) {
+  if (value < 0 && base == 10) return unsignedToText(-(unsigned long)(long)value, buffer, base, true);
+  return unsignedToText((unsigned int)value, buffer, base, false);
+}
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+  size_t n = 0;
+  while (size--) n += write(*buffer++);
+  return n;
+}
+size_t Print::print(const __FlashStringHelper *s) { return write((const char *)s); }
+size_t Print::print(const char *s) { return write(s); }
+size_t Print::print(char c) { return write((uint8_t)c); }
+size_t Print::print(unsigned char b, int base) { return print((unsigned long)b, base); }
+size_t Print::print(int n, int base) { return print((long)n, base); }
+size_t Print::print(unsigned int n, int base) { return print((unsigned long)n, base); }
+size_t Print::print(long n, int base) {
+  char text[34];
+  if (base != DEC) return print((unsigned long)n, base);
+  return write(ltoa(n, text, base));
+}
+size_t Print::print(unsigned long n, int base) {
+  char text[34];
+  if (base == 0) return write((uint8_t)n);
+  return write(ultoa(n, text, base));
+}
+size_t Print::print(double n, int digits) {
+  char text[40];
+  snprintf(text, sizeof(text), "%.*f", digits, n);
+  return write(text);
+}
+size_t Print::println() { return write("\r\n"); }
+
+size_t Stream::readBytes(char *buffer, size_t length) {
+  size_t count = 0;
+  while (count < length && available()) buffer[count++] = read();
+  return count;
+}
+
+size_t HardwareSerial::write(uint8_t b) {
+  putchar(b);
+  return 1;
+}
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+  return fwrite(buffer, 1, size, stdout);
+}
+int HardwareSerial::available() { return (uint16_t)(_inputEnd - _inputStart); }
+int HardwareSerial::read() {
+  if (_inputStart == _inputEnd) return -1;
+  return (uint8_t)_input[_inputStart++ % sizeof(_input)];
+}
+int HardwareSerial::peek() {
+  if (_inputStart == _inputEnd) return -1;
+  return (uint8_t)_input[_inputStart % sizeof(_input)];
+}
+void HardwareSerial::feed(const char *text) {
+  while (*text && (uint16_t)(_inputEnd - _inputStart) < sizeof(_input))
+    _input[_inputEnd++ % sizeof(_input)] = *text++;
+}
+
+HardwareSerial Serial, Serial1, Serial2, Serial3;
+
+#include <EEPROM.h>
+EEPROMClass EEPROM;
@@ -0,0 +1,197 @@
+/*
+ *  © 2026 agent
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef Arduino_h
+#define Arduino_h
+
+/*
+ * Just enough of the Arduino core for building parts of the command station
+ * on a Linux host (see test/host/Makefile).  The board is a Mega 2560
+ * (ARDUINO_AVR_MEGA2560 is defined by the Makefile, as by the real tool
+ * chain), for the pin and memory settings, but no ARDUINO_ARCH_xxx is
+ * defined, so the code takes its portable paths rather than touching AVR
+ * registers.
+ *
+ * Time is virtual: micros() and millis() only move when the test calls
+ * advanceMicros() (or delay()), so runs are repeatable and a benchmark can
+ * charge each operation whatever it would cost on the target.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <math.h>
+#include <ctype.h>
+#include <type_traits>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+#define NUM_DIGITAL_PINS 70
+#define NOT_A_PIN 0
+#define LED_BUILTIN 13
+#define A0 54
+#define A1 55
+#define A2 56
+#define A3 57
+#define F_CPU 16000000UL
+
+// Flash strings are ordinary strings on the host.
+class __FlashStringHelper;
+#define PROGMEM
+#define F(s) ((const __FlashStringHelper *)(s))
+#define PSTR(s) (s)
+#define pgm_read_byte_near(a) (*(const uint8_t *)(a))
+#define pgm_read_byte(a) (*(const uint8_t *)(a))
+#define pgm_read_word_near(a) (*(const uint16_t *)(a))
+#define pgm_read_word(a) (*(const uint16_t *)(a))
+#define pgm_read_dword(a) (*(const uint32_t *)(a))
+#define strlen_P strlen
+#define strcpy_P strcpy
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define memcpy_P memcpy
+
+// Virtual clock
+unsigned long micros();
+unsigned long millis();
+void advanceMicros(unsigned long interval);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+// A periodic timer interrupt (the DCC waveform), run by advanceMicros() at
+// each multiple of the period that virtual time passes.  yield() moves time
+// on to the next tick, so a loop waiting for the interrupt gets it.
+void setTimerInterrupt(void (*handler)(), unsigned long period);
+void yield();
+
+// Pins are held in an array, so that digitalWrite and digitalRead agree.
+// For the fast pin access used by MotorDriver, each pin is a port of its own.
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+void attachInterrupt(uint8_t interrupt, void (*handler)(), int mode);
+#define digitalPinToInterrupt(p) (p)
+#define digitalPinToPort(p) (p)
+#define digitalPinToBitMask(p) ((uint8_t)1)
+volatile uint8_t *portInputRegister(uint8_t port);
+volatile uint8_t *portOutputRegister(uint8_t port);
+inline void noInterrupts() {}
+inline void interrupts() {}
+extern uint8_t SREG;
+inline void cli() {}
+inline void sei() {}
+long map(long x, long inMin, long inMax, long outMin, long outMax);
+long random(long max);
+long random(long min, long max);
+
+// Functions rather than the core's macros, so that std:: headers still work.
+template<typename T, typename U> inline typename std::common_type<T, U>::type min(T a, U b) { return a < b ? a : b; }
+template<typename T, typename U> inline typename std::common_type<T, U>::type max(T a, U b) { return a > b ? a : b; }
+template<typename T> inline T abs(T a) { return a < 0 ? -a : a; }
+template<typename T, typename U, typename V> inline T constrain(T a, U low, V high) {
+  return a < low ? low : a > high ? high : a;
+}
+#define bitRead(v, b) (((v) >> (b)) & 1)
+#define bitSet(v, b) ((v) |= (1UL << (b)))
+#define bitClear(v, b) ((v) &= ~(1UL << (b)))
+#define bitWrite(v, b, x) ((x) ? bitSet(v, b) : bitClear(v, b))
+#define lowByte(w) ((uint8_t)((w) & 0xff))
+#define highByte(w) ((uint8_t)((w) >> 8))
+
+// avr-libc conversions used by the formatter
+char *itoa(int value, char *buffer, int base);
+char *utoa(unsigned int value, char *buffer, int base);
+char *ltoa(long value, char *buffer, int base);
+char *ultoa(unsigned long value, char *buffer, int base);
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t b) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  size_t write(const char *s) { return s ? write((const uint8_t *)s, strlen(s)) : 0; }
+  size_t write(const char *buffer, size_t size) { return write((const uint8_t *)buffer, size); }
+  virtual int availableForWrite() { return 0; }
+  virtual void flush() {}
+
+  size_t print(const __FlashStringHelper *s);
+  size_t print(const char *s);
+  size_t print(char c);
+  size_t print(unsigned char b, int base = DEC);
+  size_t print(int n, int base = DEC);
+  size_t print(unsigned int n, int base = DEC);
+  size_t print(long n, int base = DEC);
+  size_t print(unsigned long n, int base = DEC);
+  size_t print(double n, int digits = 2);
+  size_t println();
+  template<typename T> size_t println(T value) { size_t n = print(value); return n + println(); }
+  template<typename T> size_t println(T value, int format) { size_t n = print(value, format); return n + println(); }
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  void setTimeout(unsigned long timeout) { _timeout = timeout; }
+  size_t readBytes(char *buffer, size_t length);
+  size_t readBytes(uint8_t *buffer, size_t length) { return readBytes((char *)buffer, length); }
+protected:
+  unsigned long _timeout = 1000;
+};
+
+// Output goes to stdout.  Input is whatever the test has put in with feed().
+class HardwareSerial : public Stream {
+public:
+  void begin(unsigned long baud) { (void)baud; }
+  void end() {}
+  operator bool() { return true; }
+  size_t write(uint8_t b) override;
+  size_t write(const uint8_t *buffer, size_t size) override;
+  using Print::write;
+  int available() override;
+  int read() override;
+  int peek() override;
+  int availableForWrite() override { return 63; }
+  void feed(const char *text);
+private:
+  char _input[256];
+  uint16_t _inputStart = 0, _inputEnd = 0;
+};
+extern HardwareSerial Serial, Serial1, Serial2, Serial3;
+
+#endif
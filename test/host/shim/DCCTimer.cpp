@@ -0,0 +1,44 @@
+/*
+ *  © 2026 agent
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Host version of DCCTimer: the 58uS interrupt runs on the virtual clock
+// (see setTimerInterrupt in Arduino.h), and no pins are driven by PWM.
+
+#include "DCCTimer.h"
+const int DCC_SIGNAL_TIME=58;  // this is the 58uS DCC 1-bit waveform half-cycle 
+
+void DCCTimer::begin(INTERRUPT_CALLBACK callback) {
+  setTimerInterrupt(callback, DCC_SIGNAL_TIME);
+}
+
+bool DCCTimer::isPWMPin(byte pin) {
+  (void)pin;
+  return false;
+}
+
+void DCCTimer::setPWM(byte pin, bool high) {
+  (void)pin;
+  (void)high;
+}
+
+void DCCTimer::getSimulatedMacAddress(byte mac[6]) {
+  static const byte simulated[6]={0xBE,0xEF,0xBE,0xEF,0xBE,0x80};
+  memcpy(mac, simulated, 6);
+}
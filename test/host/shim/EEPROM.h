@@ -0,0 +1,82 @@
+/*
+ *  © 2026 agent
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef EEPROM_h
+#define EEPROM_h
+#include <Arduino.h>
+
+/*
+ * Emulated EEPROM.  It starts erased (0xFF) and counts the byte reads, and
+ * the byte writes made to each cell, so that tests can report wear and write amplification.
+ * The size may be changed (before use) to model the smaller boards, and
+ * the contents saved and restored to carry them across a simulated restart.
+ */
+class EEPROMClass {
+public:
+  static const uint16_t MAX_SIZE = 4096;   // Mega 2560
+
+  EEPROMClass() { setLength(MAX_SIZE); }
+  void setLength(uint16_t length) {
+    _length = length;
+    memset(_data, 0xFF, sizeof(_data));
+    resetCounts();
+  }
+  uint16_t length() { return _length; }
+  uint8_t *contents() { return _data; }
+  void resetCounts() {
+    memset(writes, 0, sizeof(writes));
+    writeCount = 0;
+    readCount = 0;
+  }
+
+  uint8_t read(int address) {
+    readCount++;
+    return inRange(address) ? _data[address] : 0xFF;
+  }
+  void write(int address, uint8_t value) {
+    if (!inRange(address)) return;
+    _data[address] = value;
+    writes[address]++;
+    writeCount++;
+  }
+  void update(int address, uint8_t value) { if (read(address) != value) write(address, value); }
+
+  // As in the AVR core, put() only writes the bytes that differ.
+  template<typename T> T &get(int address, T &t) {
+    uint8_t *p = (uint8_t *)&t;
+    for (size_t i = 0; i < sizeof(T); i++) p[i] = read(address + i);
+    return t;
+  }
+  template<typename T> const T &put(int address, const T &t) {
+    const uint8_t *p = (const uint8_t *)&t;
+    for (size_t i = 0; i < sizeof(T); i++) update(address + i, p[i]);
+    return t;
+  }
+
+  unsigned long writeCount;          // byte writes since resetCounts()
+  unsigned long readCount;           // byte reads since resetCounts()
+  unsigned long writes[MAX_SIZE];    // byte writes to each cell
+
+private:
+  bool inRange(int address) { return address >= 0 && address < _length; }
+  uint16_t _length;
+  uint8_t _data[MAX_SIZE];
+};
+extern EEPROMClass EEPROM;
+#endif
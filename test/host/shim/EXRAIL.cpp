@@ -0,0 +1,38 @@
+/*
+ *  © 2026 agent
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// The EXRAIL tables, as EXRAILMacros.h builds them from an empty
+// myAutomation.h.  The sketch's own myAutomation.h needs the network
+// libraries, which the host does not have, so the host runs no script.
+
+#include "defines.h"
+#include "EXRAIL2.h"
+
+const int16_t FLASH RMFT2::routeIdList[]= {0};
+const int16_t FLASH RMFT2::automationIdList[]= {0};
+const FSH * RMFT2::getRouteDescription(int16_t id) { (void)id; return F(""); }
+void RMFT2::printMessage(uint16_t id) { (void)id; }
+const FSH * RMFT2::getTurnoutDescription(int16_t turnoutid) { (void)turnoutid; return NULL; }
+const byte RMFT2::rosterNameCount=0;
+const int16_t FLASH RMFT2::rosterIdList[]={0};
+const FSH * RMFT2::getRosterName(int16_t id) { (void)id; return F(""); }
+const FSH * RMFT2::getRosterFunctions(int16_t id) { (void)id; return F(""); }
+const FLASH int16_t RMFT2::SignalDefinitions[] = {0,0,0,0};
+const FLASH byte RMFT2::RouteCode[] = {OPCODE_ENDTASK,0,0,OPCODE_ENDEXRAIL,0,0};
@@ -0,0 +1,283 @@
+/*
+ *  © 2026 agent
+ *  All rights reserved.
+ *
+ *  This file is part of CommandStation-EX
+ *
+ *  This is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  It is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with CommandStation.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * WiThrottle load generator: WifiInboundHandler, CommandDistributor,
+ * WiThrottle and DCC running on the host, on virtual time, behind an
+ * emulated ESP8266 running the AT firmware.
+ *
+ *   withrottle_load [clients] [seconds] [interval_ms]
+ *
+ * Each client (default 4, up to the 5 links the AT firmware allows)
+ * connects, acquires its own loco and then sends a speed change about every
+ * <interval_ms> (default 250).  The latency of a speed change runs from
+ * the throttle sending it to the throttle receiving the M..A..V echo of
+ * that speed or a later one, and the percentiles over all the clients are
+ * reported at the end.
+ *
+ * The link to the ESP is 115200 baud each way, with the 64 byte receive
+ * and transmit buffers of the AVR core: writes wait for space, and input
+ * that arrives with the receive buffer full is lost.  The ESP answers
+ * AT+CIPSEND with the > prompt after ESP_PROMPT_MICROS, and reports SEND OK
+ * ESP_SEND_MICROS after the data, and WiFi adds WIFI_MICROS each way.  Each
+ * loop() is charged LOOP_OVERHEAD for the rest of the command station.
+ * These are rough figures for an ESP-01 on a quiet network; the point is to
+ * compare changes to the command station, not to predict a layout.
+ *
+ * Each speed change is a DCC packet of about 10ms on the track, so beyond
+ * about 100 changes a second in all, schedulePacket() waits for the track
+ * and the serial input overflows.
+ */
+
+#include <chrono>
+#include <deque>
+#include <queue>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "DCC.h"
+#include "MotorDrivers.h"
+#include "WifiInboundHandler.h"
+
+#define LINK_BYTE_MICROS 87     // 10 bits at 115200 baud
+#define LINK_BUFFER 64          // AVR HardwareSerial buffers
+#define ESP_PROMPT_MICROS 1000  // AT+CIPSEND to >
+#define ESP_SEND_MICROS 2000    // data to SEND OK
+#define WIFI_MICROS 2000        // one way, ESP to throttle
+#define LOOP_OVERHEAD 200       // microseconds
+#define MAX_CLIENTS 5
+
+// Things that happen at a given virtual time.
+struct Event {
+  unsigned long time;
+  unsigned long order;  // events at the same time run in the order made
+  enum { ESP_OUTPUT, THROTTLE_RECEIVE, THROTTLE_SEND } type;
+  int client;
+  std::string text;
+  bool operator<(const Event &other) const {  // for the priority_queue
+    if (time != other.time) return (long)(time - other.time) > 0;
+    return order > other.order;
+  }
+};
+static std::priority_queue<Event> events;
+static unsigned long eventCount = 0;
+static void schedule(unsigned long time, int type, int client, const std::string &text) {
+  events.push(Event{time, eventCount++, (decltype(Event::type))type, client, text});
+}
+
+struct Throttle {
+  int cab;
+  int speed = 0;
+  std::string line;    // received so far
+  struct Pending { int speed; unsigned long sent; };
+  std::deque<Pending> pending;
+};
+static Throttle throttles[MAX_CLIENTS];
+static std::vector<unsigned long> latencies;
+static unsigned long commandsSent = 0;
+static unsigned long intervalMicros;
+
+// The serial link to the ESP, and the ESP's AT command processing.
+class EspLink : public Stream {
+public:
+  unsigned long cipsends = 0;
+  unsigned long overflows = 0;
+
+  // ESP output, queued on the link from the given time.
+  void output(unsigned long time, const std::string &text) {
+    for (char c : text) {
+      rxFree = std::max(rxFree, time) + LINK_BYTE_MICROS;
+      rxLink.push_back(Byte{rxFree, (uint8_t)c});
+    }
+  }
+
+  int available() override { receive(); return rxBuffer.size(); }
+  int read() override {
+    receive();
+    if (rxBuffer.empty()) return -1;
+    uint8_t c = rxBuffer.front();
+    rxBuffer.pop_front();
+    return c;
+  }
+  int peek() override { receive(); return rxBuffer.empty() ? -1 : rxBuffer.front(); }
+
+  size_t write(uint8_t c) override {
+    unsigned long now = micros();
+    txFree = std::max(txFree, now) + LINK_BYTE_MICROS;
+    // Wait for room in the transmit buffer.
+    if (txFree - now > LINK_BUFFER * LINK_BYTE_MICROS)
+      advanceMicros(txFree - now - LINK_BUFFER * LINK_BYTE_MICROS);
+    esp(txFree, c);
+    return 1;
+  }
+  using Print::write;
+
+private:
+  struct Byte { unsigned long time; uint8_t c; };
+  std::deque<Byte> rxLink;       // on the way from the ESP
+  std::deque<uint8_t> rxBuffer;  // arrived, not yet read
+  unsigned long rxFree = 0, txFree = 0;
+  std::string command;
+  int sendClient = -1;
+  size_t sendLength = 0;
+  std::string sendData;
+
+  void receive() {
+    unsigned long now = micros();
+    while (!rxLink.empty() && (long)(rxLink.front().time - now) <= 0) {
+      if (rxBuffer.size() < LINK_BUFFER) rxBuffer.push_back(rxLink.front().c);
+      else overflows++;
+      rxLink.pop_front();
+    }
+  }
+
+  // A byte from the command station reaches the ESP.
+  void esp(unsigned long time, uint8_t c) {
+    if (sendClient >= 0) {
+      sendData += (char)c;
+      if (sendData.size() < sendLength) return;
+      schedule(time + WIFI_MICROS, Event::THROTTLE_RECEIVE, sendClient, sendData);
+      schedule(time + ESP_SEND_MICROS, Event::ESP_OUTPUT, sendClient,
+        "\r\nRecv " + std::to_string(sendLength) + " bytes\r\n\r\nSEND OK\r\n");
+      sendClient = -1;
+      return;
+    }
+    if (c != '\n') {
+      command += (char)c;
+      return;
+    }
+    int client, length;
+    if (sscanf(command.c_str(), "AT+CIPSEND=%d,%d", &client, &length) == 2) {
+      cipsends++;
+      sendClient = client;
+      sendLength = length;
+      sendData.clear();
+      schedule(time + ESP_PROMPT_MICROS, Event::ESP_OUTPUT, client, "\r\nOK\r\n> ");
+    }
+    command.clear();
+  }
+};
+static EspLink esp;
+
+static void throttleSend(int client, const std::string &text) {
+  schedule(micros() + WIFI_MICROS, Event::ESP_OUTPUT, client,
+    "\r\n+IPD," + std::to_string(client) + "," + std::to_string(text.size()) + ":" + text);
+}
+
+static void throttleReceive(int client, const std::string &text) {
+  Throttle &t = throttles[client];
+  for (char c : text) {
+    if (c != '\n') {
+      t.line += c;
+      continue;
+    }
+    // MTAL1000<;>V35 is the speed, as sent or as changed by another client.
+    std::string prefix = "MTAL" + std::to_string(t.cab) + "<;>V";
+    if (t.line.compare(0, prefix.size(), prefix) == 0) {
+      int speed = atoi(t.line.c_str() + prefix.size());
+      auto match = std::find_if(t.pending.begin(), t.pending.end(),
+        [speed](const Throttle::Pending &p) { return p.speed == speed; });
+      if (match != t.pending.end()) {
+        // Earlier changes were overtaken: they are done as well.
+        for (auto p = t.pending.begin(); p <= match; p++)
+          latencies.push_back(micros() - p->sent);
+        t.pending.erase(t.pending.begin(), match + 1);
+      }
+    }
+    t.line.clear();
+  }
+}
+
+static void throttleNext(int client) {
+  Throttle &t = throttles[client];
+  t.speed = t.speed % 126 + 1;
+  t.pending.push_back(Throttle::Pending{t.speed, micros()});
+  commandsSent++;
+  throttleSend(client, "MTAL" + std::to_string(t.cab) + "<;>V" + std::to_string(t.speed) + "\n");
+  // Spread the clients out with up to +-25% on the interval.
+  schedule(micros() + intervalMicros * 3 / 4 + random(intervalMicros / 2),
+    Event::THROTTLE_SEND, client, "");
+}
+
+static void runEvents() {
+  while (!events.empty() && (long)(events.top().time - micros()) <= 0) {
+    Event e = events.top();
+    events.pop();
+    switch (e.type) {
+      case Event::ESP_OUTPUT: esp.output(e.time, e.text); break;
+      case Event::THROTTLE_RECEIVE: throttleReceive(e.client, e.text); break;
+      case Event::THROTTLE_SEND: throttleNext(e.client); break;
+    }
+  }
+}
+
+static unsigned long percentile(int p) {
+  return latencies[std::min(latencies.size() - 1, latencies.size() * p / 100)];
+}
+
+int main(int argc, char **argv) {
+  int clients = argc > 1 ? atoi(argv[1]) : 4;
+  unsigned long seconds = argc > 2 ? atol(argv[2]) : 60;
+  intervalMicros = (argc > 3 ? atol(argv[3]) : 250) * 1000UL;
+  if (clients < 1 || clients > MAX_CLIENTS || seconds < 1 || intervalMicros < 1000) {
+    fprintf(stderr, "usage: withrottle_load [clients 1-%d] [seconds] [interval_ms]\n", MAX_CLIENTS);
+    return 2;
+  }
+  srand(1);
+
+  DCC::begin(STANDARD_MOTOR_SHIELD);
+  WifiInboundHandler::setup(&esp);
+
+  // Connect, acquire a loco each, and start driving after a second.
+  for (int client = 0; client < clients; client++) {
+    throttles[client].cab = 1000 + client;
+    std::string cab = std::to_string(throttles[client].cab);
+    throttleSend(client, "NLoad " + std::to_string(client) + "\nHU" + std::to_string(client) + "\n");
+    throttleSend(client, "MT+L" + cab + "<;>L" + cab + "\n");
+    schedule(1000000UL + client * intervalMicros / clients, Event::THROTTLE_SEND, client, "");
+  }
+
+  unsigned long loops = 0;
+  unsigned long endMicros = micros() + seconds * 1000000UL;
+  std::chrono::nanoseconds cpu(0);
+  while (micros() < endMicros) {
+    runEvents();
+    auto start = std::chrono::steady_clock::now();
+    WifiInboundHandler::loop();
+    DCC::loop();
+    cpu += std::chrono::steady_clock::now() - start;
+    loops++;
+    advanceMicros(LOOP_OVERHEAD);
+  }
+
+  unsigned long outstanding = 0;
+  for (int client = 0; client < clients; client++) outstanding += throttles[client].pending.size();
+  printf("WiThrottle load: %d clients, a speed change every %lums each, %lus virtual time\n",
+    clients, intervalMicros / 1000, seconds);
+  printf("speed changes:%lu echoed:%lu outstanding:%lu CIPSENDs:%lu receive overflows:%lu\n",
+    commandsSent, (unsigned long)latencies.size(), outstanding, esp.cipsends, esp.overflows);
+  printf("loop() calls:%lu host CPU:%ldns per loop()\n", loops, (long)(cpu.count() / loops));
+  if (latencies.empty()) return 1;
+  std::sort(latencies.begin(), latencies.end());
+  printf("latency ms: p50=%.1f p90=%.1f p99=%.1f max=%.1f\n",
+    percentile(50) / 1000.0, percentile(90) / 1000.0, percentile(99) / 1000.0,
+    latencies.back() / 1000.0);
+  return 0;
+}